@@ -0,0 +1,76 @@
+#pragma once
+#include "chip8.h"
+
+// Ahead-of-time translated ROMs. chip8-aotc (aotc.c) walks a ROM's control flow and writes it out as C, one label per
+// basic block. Compiled into a program (make AOT=file.c), the translation registers itself at startup, chip_load_mem
+// attaches it to any machine loading that exact ROM under the same profile, and chip_run runs the native code instead of
+// the interpreter. Anything the walk didn't find, and any block something has written over since, goes through
+// chip_cycle one instruction at a time, so results are the same as the interpreter's either way.
+// Idle loops are run rather than skipped, which costs next to nothing once they're native code
+
+struct chip_aot {
+    const char *name;        // ROM it was made from, for messages
+    enum chip_quirks quirks; // Profile it was made for, other profiles use the interpreter
+    const u8 *rom;           // The ROM as loaded at 0x200
+    u32 rom_size;
+    const u8 *code;          // Bit (a - 0x200) is set where translated code reads byte a
+    bool (*run)(struct chip8 *chip, u16 key_mask, u16 deltatime, u32 cycles); // chip_run for this ROM
+    struct chip_aot *next;   // Registered translations, see chip_aot_register
+};
+
+// Make a translation available to chip_load_mem. Generated files call this from a constructor
+void chip_aot_register(struct chip_aot *aot);
+
+// The translation registered for exactly this ROM and profile, NULL if there isn't one
+const struct chip_aot *chip_aot_find(const u8 *rom, size_t size, enum chip_quirks quirks);
+
+// Whether mem[addr..addr+len) still holds what the translation was made from
+bool chip_aot_intact(const struct chip8 *chip, u16 addr, u16 len);
+
+// The rest is for generated code, inside a run function with chip, key_mask, deltatime, cycles, redraw and a step
+// label in scope
+
+// Same xorshift as chip_rand, so CXNN gives the same numbers translated or not
+static inline u8 aot_rand(struct chip8 *chip)
+{
+    u32 r = chip->rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    chip->rng = r;
+    return r >> 24;
+}
+
+// Start of a block of `len` instructions at `addr`. Like chip_run it takes the whole block at once, or falls back to a
+// single chip_cycle step if the budget runs out or a timer ticks inside it, or if the block has been written over
+#define AOT_ENTER(addr, len) \
+    do { \
+        if (cycles < (len) || (deltatime && chip->timer + (u32)(len) * deltatime * 60 >= 1000) || \
+            ((addr) < chip->aot_hi && (addr) + (len) * 2 > chip->aot_lo && !chip_aot_intact(chip, (addr), (len) * 2))) \
+            goto step; \
+        cycles -= (len); \
+        chip->timer += (u32)(len) * deltatime * 60; \
+    } while (0)
+
+// An instruction left to the interpreter. AOT_ENTER already counted its cycle and its time
+#define AOT_CYCLE(addr) \
+    do { \
+        chip->pc = (addr); \
+        redraw |= chip_cycle(chip, key_mask, 0); \
+    } while (0)
+
+// FX0A. With nothing pressed every cycle left would just run it again, so with no time passing either that's the end
+// of the budget, same as chip_run's idle skip
+#define AOT_KEY_WAIT(addr) \
+    do { \
+        chip->pc = (addr); \
+        if (!key_mask && !deltatime) { \
+            cycles = 0; \
+            goto dispatch; \
+        } \
+        redraw |= chip_cycle(chip, key_mask, 0); \
+    } while (0)
+
+// XO-CHIP's skip, which steps over F000 NNNN as a whole. pc already points past the skip
+#define AOT_SKIP_XO() \
+    (chip->pc += (CHIP_MEM(chip, chip->pc & 0xFFFF) == 0xF0 && CHIP_MEM(chip, (chip->pc + 1) & 0xFFFF) == 0x00) ? 4 : 2)
@@ -0,0 +1,458 @@
+#define _POSIX_C_SOURCE 200809L
+// chip8-aotc: translate a ROM into C ahead of time, see aot.h for what happens to the output
+#include "chip8.h"
+#include "disasm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define AOTC_BLOCK_MAX 32 // Longest block. chip_run's budget has to cover a whole block for it to run natively
+
+// What an instruction turns into, and where execution goes after it
+enum aotc_kind {
+    AOTC_NATIVE,   // Inline C, then the next instruction
+    AOTC_CALL_OUT, // chip_cycle, then the next instruction
+    AOTC_EXIT,     // chip_cycle, then back through the dispatch since pc or memory may have changed under us
+    AOTC_JUMP,
+    AOTC_CALL,
+    AOTC_RET,
+    AOTC_SKIP,
+    AOTC_INDIRECT, // BNNN, could land anywhere in the 256 bytes from NNN
+};
+
+// The quirks chip8.c builds each interpreter with, for the few inline ops that depend on them
+struct aotc_profile {
+    const char *name;
+    bool shift_vx, jump_vx, addi_carry, logic_vf, xo;
+};
+
+static const struct aotc_profile profiles[QUIRKS_COUNT] = {
+    [QUIRKS_DEFAULT] = { "default", .addi_carry = true },
+    [QUIRKS_CHIP8]   = { "chip8", .logic_vf = true },
+    [QUIRKS_SCHIP]   = { "schip", .shift_vx = true, .jump_vx = true },
+    [QUIRKS_XO]      = { "xochip", .xo = true },
+};
+
+static const char *const quirk_enums[QUIRKS_COUNT] = {
+    [QUIRKS_DEFAULT] = "QUIRKS_DEFAULT",
+    [QUIRKS_CHIP8] = "QUIRKS_CHIP8",
+    [QUIRKS_SCHIP] = "QUIRKS_SCHIP",
+    [QUIRKS_XO] = "QUIRKS_XO",
+};
+
+struct aotc {
+    enum chip_quirks quirks;
+    const struct aotc_profile *profile;
+    u32 mask;
+    u8 rom[0x10000];
+    u32 size;
+
+    u8 seen[0x10000];   // Reached by the walk
+    u8 leader[0x10000]; // Starts a block, so it gets a label
+    u16 work[0x8000];   // Addresses seen but not walked yet
+    u32 pending;
+};
+
+static struct aotc aotc; // Too big for the stack
+
+// Only whole, even-aligned instructions inside the ROM are translated. Everything else is left to chip_cycle
+static bool aotc_in_rom(const struct aotc *t, u32 a)
+{
+    return !(a & 1) && a >= 0x200 && a + 1 < 0x200 + t->size;
+}
+
+static u16 aotc_word(const struct aotc *t, u32 a)
+{
+    return (t->rom[a - 0x200] << 8) | t->rom[a - 0x200 + 1];
+}
+
+static enum aotc_kind aotc_kind(const struct aotc *t, u16 insn)
+{
+    u8 nn = insn & 0xFF;
+    switch (insn >> 12) {
+        case 0x0:
+            if (insn == 0x00EE) return AOTC_RET;
+            if (insn == 0x00FD) return AOTC_EXIT; // Parks pc on itself
+            return AOTC_CALL_OUT; // 00E0, SUPER-CHIP scrolls and modes, or nothing at all
+        case 0x1: return AOTC_JUMP;
+        case 0x2: return AOTC_CALL;
+        case 0x3: case 0x4: case 0x9: return AOTC_SKIP;
+        case 0x5:
+            if (t->profile->xo && (insn & 0xF) == 0x2) return AOTC_EXIT; // 5XY2 stores to memory
+            if (t->profile->xo && (insn & 0xF) == 0x3) return AOTC_CALL_OUT;
+            return AOTC_SKIP;
+        case 0xB: return AOTC_INDIRECT;
+        case 0xD: return AOTC_CALL_OUT;
+        case 0xE: return (nn == 0x9E || nn == 0xA1) ? AOTC_SKIP : AOTC_NATIVE;
+        case 0xF:
+            switch (nn) {
+                case 0x07: case 0x15: case 0x18: case 0x1E: case 0x29: return AOTC_NATIVE;
+                case 0x0A: case 0x33: case 0x55: return AOTC_EXIT;
+                case 0x00: return insn == 0xF000 ? AOTC_EXIT : AOTC_CALL_OUT; // F000 NNNN eats the next word
+            }
+            return AOTC_CALL_OUT;
+    }
+    return AOTC_NATIVE; // 6XNN, 7XNN, 8XYN, ANNN, CXNN
+}
+
+static void aotc_push(struct aotc *t, u32 a, bool leader)
+{
+    a &= t->mask;
+    if (!aotc_in_rom(t, a))
+        return;
+    if (leader)
+        t->leader[a] = 1;
+    if (!t->seen[a]) {
+        t->seen[a] = 1;
+        t->work[t->pending++] = a;
+    }
+}
+
+// Follow every path from 0x200, assuming calls return to the instruction after them
+static void aotc_walk(struct aotc *t)
+{
+    aotc_push(t, 0x200, true);
+    while (t->pending) {
+        u32 a = t->work[--t->pending];
+        u16 insn = aotc_word(t, a);
+        u32 next = (a + 2) & t->mask;
+        switch (aotc_kind(t, insn)) {
+            case AOTC_NATIVE:
+            case AOTC_CALL_OUT:
+                aotc_push(t, next, false);
+                break;
+            case AOTC_EXIT:
+                aotc_push(t, next, true);
+                if (insn == 0xF000)
+                    aotc_push(t, next + 2, true);
+                break;
+            case AOTC_JUMP:
+                aotc_push(t, insn & 0xFFF, true);
+                break;
+            case AOTC_CALL:
+                aotc_push(t, insn & 0xFFF, true);
+                aotc_push(t, next, true);
+                break;
+            case AOTC_RET:
+                break;
+            case AOTC_SKIP:
+                aotc_push(t, next, true);
+                aotc_push(t, next + 2, true);
+                if (t->profile->xo)
+                    aotc_push(t, next + 4, true); // Skipped over an F000 NNNN
+                break;
+            case AOTC_INDIRECT:
+                for (u32 off = 0; off < 256; off++)
+                    aotc_push(t, (insn & 0xFFF) + off, true);
+                break;
+        }
+    }
+}
+
+// goto to a: its label if it has one, otherwise the dispatch sorts it out
+static void aotc_goto(FILE *out, const struct aotc *t, u32 a)
+{
+    if (a <= t->mask && t->leader[a])
+        fprintf(out, "    goto L%03X;\n", a);
+    else
+        fprintf(out, "    goto dispatch;\n");
+}
+
+static void aotc_native(FILE *out, const struct aotc *t, u16 insn)
+{
+    u8 x = (insn >> 8) & 0xF, y = (insn >> 4) & 0xF, nn = insn & 0xFF;
+    switch (insn >> 12) {
+        case 0x6:
+            fprintf(out, "    v[0x%X] = 0x%02X;\n", x, nn);
+            return;
+        case 0x7:
+            fprintf(out, "    v[0x%X] += 0x%02X;\n", x, nn);
+            return;
+        case 0x8:
+            switch (insn & 0xF) {
+                case 0x0:
+                    fprintf(out, "    v[0x%X] = v[0x%X];\n", x, y);
+                    return;
+                case 0x1: case 0x2: case 0x3:
+                    fprintf(out, "    v[0x%X] %c= v[0x%X];\n", x, "|&^"[(insn & 0xF) - 1], y);
+                    if (t->profile->logic_vf)
+                        fprintf(out, "    v[0xF] = 0;\n");
+                    return;
+                // With x == y the flags are constants, and spelling out the comparison only gets a warning
+                case 0x4:
+                    if (x == y)
+                        fprintf(out, "    v[0x%X] += v[0x%X];\n    v[0xF] = 0;\n", x, y);
+                    else
+                        fprintf(out, "    v[0x%X] += v[0x%X];\n    v[0xF] = (v[0x%X] < v[0x%X]);\n", x, y, x, y);
+                    return;
+                case 0x5:
+                    if (x == y)
+                        fprintf(out, "    v[0x%X] = 0;\n    v[0xF] = 1;\n", x);
+                    else
+                        fprintf(out, "    { u8 f = v[0x%X] >= v[0x%X]; v[0x%X] -= v[0x%X]; v[0xF] = f; }\n", x, y, x, y);
+                    return;
+                case 0x7:
+                    if (x == y)
+                        fprintf(out, "    v[0x%X] = 0;\n    v[0xF] = 1;\n", x);
+                    else
+                        fprintf(out, "    { u8 f = v[0x%X] >= v[0x%X]; v[0x%X] = v[0x%X] - v[0x%X]; v[0xF] = f; }\n",
+                                y, x, x, y, x);
+                    return;
+                case 0x6: case 0xE:
+                    if (!t->profile->shift_vx)
+                        fprintf(out, "    v[0x%X] = v[0x%X];\n", x, y);
+                    if ((insn & 0xF) == 0x6)
+                        fprintf(out, "    { u8 c = v[0x%X] & 0x1; v[0x%X] >>= 1; v[0xF] = c; }\n", x, x);
+                    else
+                        fprintf(out, "    { u8 c = (v[0x%X] & 0x80) >> 7; v[0x%X] <<= 1; v[0xF] = c; }\n", x, x);
+                    return;
+            }
+            return; // Not an instruction, does nothing
+        case 0xA:
+            fprintf(out, "    chip->i = 0x%03X;\n", insn & 0xFFF);
+            return;
+        case 0xC:
+            fprintf(out, "    v[0x%X] = aot_rand(chip) & 0x%02X;\n", x, nn);
+            return;
+        case 0xF:
+            switch (nn) {
+                case 0x07:
+                    fprintf(out, "    v[0x%X] = chip->delay;\n", x);
+                    return;
+                case 0x15:
+                    fprintf(out, "    chip->delay = v[0x%X];\n", x);
+                    return;
+                case 0x18:
+                    fprintf(out, "    chip->sound = v[0x%X];\n", x);
+                    return;
+                case 0x1E:
+                    fprintf(out, "    {\n        u32 sum = chip->i + v[0x%X];\n", x);
+                    if (t->profile->addi_carry)
+                        fprintf(out, "        v[0xF] = (sum > 0x%X);\n", t->mask);
+                    fprintf(out, "        chip->i = sum & 0x%X;\n    }\n", t->mask);
+                    return;
+                case 0x29:
+                    fprintf(out, "    chip->i = font_addr + v[0x%X]*5;\n", x);
+                    return;
+            }
+            return;
+    }
+    // EXNN other than EX9E/EXA1 does nothing
+}
+
+// The condition a skip skips on
+static void aotc_condition(char *buf, size_t size, u16 insn)
+{
+    u8 x = (insn >> 8) & 0xF, y = (insn >> 4) & 0xF, nn = insn & 0xFF;
+    switch (insn >> 12) {
+        case 0x3: snprintf(buf, size, "v[0x%X] == 0x%02X", x, nn); return;
+        case 0x4: snprintf(buf, size, "v[0x%X] != 0x%02X", x, nn); return;
+        case 0x5: snprintf(buf, size, x == y ? "1" : "v[0x%X] == v[0x%X]", x, y); return;
+        case 0x9: snprintf(buf, size, x == y ? "0" : "v[0x%X] != v[0x%X]", x, y); return;
+    }
+    if ((insn & 0xFF) == 0x9E)
+        snprintf(buf, size, "(key_mask & (1 << v[0x%X])) > 0", x);
+    else
+        snprintf(buf, size, "(key_mask & (1 << v[0x%X])) == 0", x);
+}
+
+// Write the block starting at a, returns its length in instructions
+static u32 aotc_block(FILE *out, struct aotc *t, u32 a)
+{
+    u32 len = 0;
+    while (len < AOTC_BLOCK_MAX) {
+        u32 at = a + len*2;
+        len++;
+        if (aotc_kind(t, aotc_word(t, at)) > AOTC_CALL_OUT)
+            break;
+        u32 next = (at + 2) & t->mask;
+        if (!aotc_in_rom(t, next) || t->leader[next])
+            break;
+    }
+
+    fprintf(out, "L%03X:\n    AOT_ENTER(0x%03X, %u);\n", a, a, len);
+    for (u32 k = 0; k < len; k++) {
+        u32 at = a + k*2;
+        u16 insn = aotc_word(t, at);
+        u32 next = (at + 2) & t->mask;
+        char text[32];
+        fprintf(out, "    // %03X: %04X  %s\n", at, insn, chip_disasm(insn, t->quirks, text, sizeof(text)));
+
+        switch (aotc_kind(t, insn)) {
+            case AOTC_NATIVE:
+                aotc_native(out, t, insn);
+                break;
+            case AOTC_CALL_OUT:
+                fprintf(out, "    AOT_CYCLE(0x%03X);\n", at);
+                break;
+            case AOTC_EXIT:
+                if ((insn & 0xF0FF) == 0xF00A)
+                    fprintf(out, "    AOT_KEY_WAIT(0x%03X);\n    goto dispatch;\n", at);
+                else
+                    fprintf(out, "    AOT_CYCLE(0x%03X);\n    goto dispatch;\n", at);
+                return len;
+            case AOTC_JUMP:
+                fprintf(out, "    chip->pc = 0x%03X;\n", insn & 0xFFF);
+                aotc_goto(out, t, insn & 0xFFF);
+                return len;
+            case AOTC_CALL:
+                fprintf(out, "    chip->stack[chip->sp++] = 0x%03X;\n    chip->pc = 0x%03X;\n", next, insn & 0xFFF);
+                aotc_goto(out, t, insn & 0xFFF);
+                return len;
+            case AOTC_RET:
+                fprintf(out, "    chip->pc = chip->stack[--chip->sp];\n    goto dispatch;\n");
+                return len;
+            case AOTC_SKIP: {
+                char cond[64];
+                aotc_condition(cond, sizeof(cond), insn);
+                if (t->profile->xo) {
+                    fprintf(out, "    chip->pc = 0x%03X;\n    if (%s)\n        AOT_SKIP_XO();\n    goto dispatch;\n",
+                            next, cond);
+                    return len;
+                }
+                // Like the interpreter's skip, pc isn't masked again after the extra 2
+                fprintf(out, "    if (%s) {\n        chip->pc = 0x%03X;\n    ", cond, next + 2);
+                aotc_goto(out, t, next + 2);
+                fprintf(out, "    }\n    chip->pc = 0x%03X;\n", next);
+                aotc_goto(out, t, next);
+                return len;
+            }
+            case AOTC_INDIRECT:
+                fprintf(out, "    chip->pc = (0x%03X + v[0x%X]) & 0x%X;\n    goto dispatch;\n",
+                        insn & 0xFFF, t->profile->jump_vx ? (insn >> 8) & 0xF : 0, t->mask);
+                return len;
+        }
+    }
+
+    // Ran into another block or the end of the ROM
+    u32 next = (a + len*2) & t->mask;
+    if (aotc_in_rom(t, next))
+        t->leader[next] = 1;
+    fprintf(out, "    chip->pc = 0x%03X;\n", next);
+    aotc_goto(out, t, next);
+    return len;
+}
+
+static void aotc_bytes(FILE *out, const u8 *bytes, u32 count)
+{
+    for (u32 k = 0; k < count; k++)
+        fprintf(out, "%s0x%02X,%s", k % 16 ? " " : "    ", bytes[k], k % 16 == 15 || k == count - 1 ? "\n" : "");
+}
+
+static void aotc_write(FILE *out, struct aotc *t, const char *name)
+{
+    fprintf(out, "// Generated by chip8-aotc from %s (%s profile), don't edit. Build it in with make AOT=this.c\n",
+            name, t->profile->name);
+    fprintf(out, "#include \"aot.h\"\n\nstatic const u8 rom[%u] = {\n", t->size);
+    aotc_bytes(out, t->rom, t->size);
+    fprintf(out, "};\n\n");
+
+    // Blocks are written in address order, so one cut short can still add the leader after it before it's reached
+    static u8 body[0x10000 / 8];
+    char *code;
+    size_t code_size;
+    FILE *blocks = open_memstream(&code, &code_size);
+    u32 count = 0, insns = 0;
+    for (u32 a = 0x200; a <= t->mask; a += 2) {
+        if (!t->leader[a])
+            continue;
+        u32 len = aotc_block(blocks, t, a);
+        for (u32 b = a - 0x200; b < a - 0x200 + len*2; b++)
+            body[b >> 3] |= 1 << (b & 7);
+        count++;
+        insns += len;
+    }
+    fclose(blocks);
+
+    fprintf(out, "// Bit per ROM byte, set where translated code came from\nstatic const u8 code[%u] = {\n",
+            (t->size + 7) / 8);
+    aotc_bytes(out, body, (t->size + 7) / 8);
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static bool run(struct chip8 *chip, u16 key_mask, u16 deltatime, u32 cycles)\n{\n"
+                 "    u8 *v = chip->v;\n    bool redraw = false;\n    (void)v;\n\n"
+                 "dispatch:\n    if (cycles == 0)\n        return redraw;\n    switch (chip->pc) {\n");
+    for (u32 a = 0x200; a <= t->mask; a += 2)
+        if (t->leader[a])
+            fprintf(out, "        case 0x%03X: goto L%03X;\n", a, a);
+    fprintf(out, "    }\n\n"
+                 "    // Not translated, or can't be run as a whole block right now\n"
+                 "step:\n    if (cycles == 0)\n        return redraw;\n    cycles--;\n    redraw |= chip_cycle(chip, key_mask, deltatime);\n    goto dispatch;\n\n");
+    fwrite(code, 1, code_size, out);
+    fprintf(out, "}\n\n");
+    free(code);
+
+    fprintf(out, "static struct chip_aot translation = {\n    .name = \"");
+    for (const char *c = name; *c; c++) {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', out);
+        fputc(*c, out);
+    }
+    fprintf(out, "\",\n    .quirks = %s,\n    .rom = rom,\n    .rom_size = sizeof(rom),\n    .code = code,\n"
+                 "    .run = run,\n};\n\n", quirk_enums[t->quirks]);
+    fprintf(out, "__attribute__((constructor)) static void aot_register(void)\n{\n"
+                 "    chip_aot_register(&translation);\n}\n");
+
+    fprintf(stderr, "%s: %u blocks, %u instructions\n", name, count, insns);
+}
+
+int main(int argc, char **argv)
+{
+    enum chip_quirks quirks = QUIRKS_DEFAULT;
+    int opt;
+    while ((opt = getopt(argc, argv, "q:")) != -1) {
+        if (opt != 'q')
+            goto usage;
+        for (quirks = 0; quirks < QUIRKS_COUNT; quirks++)
+            if (strcmp(optarg, profiles[quirks].name) == 0)
+                break;
+        if (quirks == QUIRKS_COUNT) {
+            fprintf(stderr, "Unknown quirks '%s'\n", optarg);
+            return 1;
+        }
+    }
+    if (argc - optind != 2)
+        goto usage;
+
+    struct aotc *t = &aotc;
+    t->quirks = quirks;
+    t->profile = &profiles[quirks];
+    t->mask = t->profile->xo ? 0xFFFF : 0xFFF;
+
+    const char *path = argv[optind];
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return 1;
+    }
+    t->size = fread(t->rom, 1, t->mask + 1 - 0x200, f);
+    bool too_big = fgetc(f) != EOF;
+    fclose(f);
+    if (too_big || t->size == 0) {
+        fprintf(stderr, "%s: %s\n", path, too_big ? "too big for the profile's memory" : "empty");
+        return 1;
+    }
+
+    aotc_walk(t);
+
+    FILE *out = fopen(argv[optind + 1], "w");
+    if (!out) {
+        perror(argv[optind + 1]);
+        return 1;
+    }
+    const char *name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    aotc_write(out, t, name);
+    if (fclose(out) != 0) {
+        perror(argv[optind + 1]);
+        return 1;
+    }
+    return 0;
+
+usage:
+    printf("Usage: ./chip8-aotc [-q QUIRKS] PROGRAM OUT\n"
+           "\tPROGRAM\tPath to a .ch8 program to translate\n"
+           "\tOUT\tC file to write, build it into chip8 with make AOT=OUT\n"
+           "\t-q QUIRKS\tProfile it will run under: default, chip8, schip or xochip (default: default)\n");
+    return 1;
+}
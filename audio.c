@@ -0,0 +1,196 @@
+#define _POSIX_C_SOURCE 200809L
+#include "audio.h"
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+#ifdef __linux__
+#include <alsa/asoundlib.h>
+#endif
+
+#define AUDIO_SILENCE 0x80
+#define AUDIO_HIGH    0xC0
+#define AUDIO_LOW     0x40
+
+static void wav_header(FILE *f, u32 samples)
+{
+    u8 h[44] = "RIFF\0\0\0\0WAVEfmt \x10\0\0\0\x01\0\x01\0\0\0\0\0\0\0\0\0\x01\0\x08\0data";
+    u32 rate = AUDIO_RATE, riff = 36 + samples;
+    memcpy(&h[4], &riff, 4);      // Little-endian hosts only, same as the rest of the file formats here
+    memcpy(&h[24], &rate, 4);     // Sample rate
+    memcpy(&h[28], &rate, 4);     // Byte rate, one byte per sample
+    memcpy(&h[40], &samples, 4);
+    fseek(f, 0, SEEK_SET);
+    fwrite(h, sizeof(h), 1, f);
+}
+
+static void audio_write(struct audio *a, const u8 *buf, u32 count)
+{
+    switch (a->backend) {
+        case AUDIO_WAV:
+            fwrite(buf, 1, count, a->wav);
+            a->wav_samples += count;
+            break;
+        case AUDIO_ALSA:
+#ifdef __linux__
+        {
+            snd_pcm_sframes_t r = snd_pcm_writei(a->pcm, buf, count);
+            if (r < 0)
+                snd_pcm_recover(a->pcm, r, 1);
+        }
+#endif
+            break;
+        case AUDIO_NULL:
+            break;
+    }
+}
+
+static void *audio_thread(void *arg)
+{
+    struct audio *a = arg;
+    u8 silence[AUDIO_PERIOD], period[AUDIO_PERIOD];
+    memset(silence, AUDIO_SILENCE, sizeof(silence));
+
+    // ALSA blocks in writei at the device's pace, the file backend keeps itself honest with an absolute deadline
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (atomic_load_explicit(&a->running, memory_order_relaxed)) {
+        const u8 *buf = silence;
+        if (atomic_load_explicit(&a->tone, memory_order_relaxed)) {
+            if (atomic_load_explicit(&a->use_pattern, memory_order_relaxed)) {
+                u64 pattern[2] = {
+                    atomic_load_explicit(&a->pattern[0], memory_order_relaxed),
+                    atomic_load_explicit(&a->pattern[1], memory_order_relaxed),
+                };
+                u32 step = atomic_load_explicit(&a->pattern_step, memory_order_relaxed);
+                for (u32 s = 0; s < AUDIO_PERIOD; s++) {
+                    u32 bit = (a->pattern_phase >> 16) & 127;
+                    period[s] = ((pattern[bit >> 6] >> (63 - (bit & 63))) & 1) ? AUDIO_HIGH : AUDIO_LOW;
+                    a->pattern_phase = (a->pattern_phase + step) & ((128 << 16) - 1);
+                }
+            }
+            else {
+                for (u32 s = 0; s < AUDIO_PERIOD; s++) {
+                    period[s] = a->wave[a->phase];
+                    a->phase = (a->phase + 1) % AUDIO_RATE;
+                }
+            }
+            buf = period;
+        }
+        audio_write(a, buf, AUDIO_PERIOD);
+
+        if (a->backend != AUDIO_ALSA) {
+            next.tv_nsec += 1000000000L / AUDIO_RATE * AUDIO_PERIOD;
+            if (next.tv_nsec >= 1000000000L) {
+                next.tv_nsec -= 1000000000L;
+                next.tv_sec++;
+            }
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+                ;
+        }
+    }
+
+    return NULL;
+}
+
+bool audio_spec_valid(const char *spec)
+{
+    size_t len = strlen(spec);
+    return strcmp(spec, "null") == 0 || strcmp(spec, "alsa") == 0 || (len > 4 && strcmp(&spec[len-4], ".wav") == 0);
+}
+
+bool audio_open(struct audio *a, const char *spec)
+{
+    memset(a, 0, sizeof(*a));
+    atomic_init(&a->tone, false);
+    atomic_init(&a->running, true);
+
+    for (u32 s = 0; s < AUDIO_RATE; s++)
+        a->wave[s] = ((s * AUDIO_TONE * 2 / AUDIO_RATE) & 1) ? AUDIO_LOW : AUDIO_HIGH;
+
+    // XO-CHIP plays its pattern at 4000*2^((pitch-64)/48) samples/sec
+    atomic_init(&a->use_pattern, false);
+    for (int p = 0; p < 256; p++)
+        a->pattern_steps[p] = (u32)(4000.0 * exp2((p - 64) / 48.0) / AUDIO_RATE * 65536.0 + 0.5);
+
+    if (strcmp(spec, "null") == 0) {
+        // No device, no thread, audio_set_tone just flips a flag nobody reads
+        a->backend = AUDIO_NULL;
+        return true;
+    }
+    else if (strcmp(spec, "alsa") == 0) {
+#ifdef __linux__
+        snd_pcm_t *pcm;
+        if (snd_pcm_open(&pcm, "default", SND_PCM_STREAM_PLAYBACK, 0) < 0)
+            return false;
+        if (snd_pcm_set_params(pcm, SND_PCM_FORMAT_U8, SND_PCM_ACCESS_RW_INTERLEAVED, 1, AUDIO_RATE, 1, 60000) < 0) {
+            snd_pcm_close(pcm);
+            return false;
+        }
+        a->pcm = pcm;
+        a->backend = AUDIO_ALSA;
+#else
+        return false;
+#endif
+    }
+    else if (audio_spec_valid(spec)) {
+        a->wav = fopen(spec, "wb");
+        if (!a->wav)
+            return false;
+        wav_header(a->wav, 0);
+        a->backend = AUDIO_WAV;
+    }
+    else {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (pthread_create(&a->thread, NULL, audio_thread, a) != 0) {
+        atomic_store(&a->running, false);
+        audio_close(a);
+        return false;
+    }
+    return true;
+}
+
+void audio_close(struct audio *a)
+{
+    if (a->backend == AUDIO_NULL)
+        return;
+
+    if (atomic_exchange(&a->running, false))
+        pthread_join(a->thread, NULL);
+
+    if (a->wav) {
+        wav_header(a->wav, a->wav_samples);
+        fclose(a->wav);
+        a->wav = NULL;
+    }
+#ifdef __linux__
+    if (a->pcm) {
+        snd_pcm_close(a->pcm);
+        a->pcm = NULL;
+    }
+#endif
+}
+
+void audio_set_tone(struct audio *a, bool on)
+{
+    atomic_store_explicit(&a->tone, on, memory_order_relaxed);
+}
+
+void audio_set_pattern(struct audio *a, const u8 pattern[16], u8 pitch)
+{
+    if (!pattern) {
+        atomic_store_explicit(&a->use_pattern, false, memory_order_relaxed);
+        return;
+    }
+    u64 half[2] = { 0, 0 };
+    for (int i = 0; i < 16; i++)
+        half[i >> 3] = (half[i >> 3] << 8) | pattern[i];
+    atomic_store_explicit(&a->pattern[0], half[0], memory_order_relaxed);
+    atomic_store_explicit(&a->pattern[1], half[1], memory_order_relaxed);
+    atomic_store_explicit(&a->pattern_step, a->pattern_steps[pitch], memory_order_relaxed);
+    atomic_store_explicit(&a->use_pattern, true, memory_order_relaxed);
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include "chip8.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#define AUDIO_RATE   8000 // Samples/sec, unsigned 8-bit mono
+#define AUDIO_PERIOD 160  // Samples handed to the backend at a time (20ms)
+#define AUDIO_TONE   440  // Hz, divides AUDIO_RATE evenly per second so the wave table loops seamlessly
+
+enum audio_backend {
+    AUDIO_NULL, // Nothing at all, for headless runs
+    AUDIO_WAV,  // Writes what would have been played into a .wav file, paced in real time
+    AUDIO_ALSA,
+};
+
+// Sound-timer audio on its own thread. The device is opened once and fed from a pre-generated square wave, or from an
+// XO-CHIP pattern; the emulation thread only ever stores atomics, so it never blocks on the sound card
+struct audio {
+    enum audio_backend backend;
+    pthread_t thread;
+    _Atomic bool tone;    // Play the tone (true) or silence
+    _Atomic bool running; // Cleared to stop the thread
+
+    u8 wave[AUDIO_RATE]; // One second of square wave
+    u32 phase;           // Next sample of `wave` to play, only touched by the audio thread
+
+    // XO-CHIP pattern, used instead of `wave` while audio_set_pattern has one. The halves are stored separately,
+    // a torn update just plays one period of a half-old pattern
+    _Atomic bool use_pattern;
+    _Atomic u64 pattern[2];   // The 128 1-bit samples, first sample in the top bit of pattern[0]
+    _Atomic u32 pattern_step; // Pattern samples per output sample, 16.16 fixed point
+    u32 pattern_steps[256];   // pattern_step for every pitch
+    u32 pattern_phase;        // 16.16 position in the pattern, only touched by the audio thread
+
+    FILE *wav;
+    u32 wav_samples;
+    void *pcm; // snd_pcm_t *, kept opaque so users of this header don't need the ALSA headers
+};
+
+// Open `spec`: "alsa", "null", or a path ending in .wav to write. Returns false if the backend couldn't be started,
+// with errno EINVAL for a spec that is none of those
+bool audio_open(struct audio *a, const char *spec);
+
+// Whether audio_open would know what to do with `spec`, so a typo can be caught with the rest of the options
+bool audio_spec_valid(const char *spec);
+void audio_close(struct audio *a);
+
+// Gate the tone on or off, call it once per frame with chip->sound > 0. Never blocks
+void audio_set_tone(struct audio *a, bool on);
+
+// Play an XO-CHIP pattern (chip->pattern at chip->pitch) instead of the square wave from now on, or go back to the
+// square wave with NULL (nothing loaded yet, or rewound to before F002). Never blocks
+void audio_set_pattern(struct audio *a, const u8 pattern[16], u8 pitch);
@@ -0,0 +1,209 @@
+#define _POSIX_C_SOURCE 200809L
+#include "batch.h"
+#include "movie.h"
+#include "sched.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct batch {
+    const char **roms;
+    int count;
+    u64 cycles;
+    u32 ipf; // For jobs without a movie
+    bool reference;
+    enum chip_quirks quirks;
+
+    pthread_mutex_t lock;
+    int next; // Index of the next job nobody has picked up yet
+};
+
+struct batch_worker {
+    struct batch *batch;
+    pthread_t thread;
+
+    int jobs;   // Jobs run
+    int failed; // Jobs that couldn't be started: ROM or movie didn't load, or didn't match
+    u64 instructions; // Actually run, idle skips not included
+    u64 block_insns; // How many of those ran as whole translated blocks
+    u64 idle_insns;  // Budget spent skipping over idle loops instead
+    double seconds;
+};
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int next_job(struct batch *batch)
+{
+    pthread_mutex_lock(&batch->lock);
+    int job = batch->next < batch->count ? batch->next++ : -1;
+    pthread_mutex_unlock(&batch->lock);
+    return job;
+}
+
+// Run one job, ROM or ROM@MOVIE, adding to the worker's counts. Returns false if it couldn't be started
+static bool batch_job(struct batch *batch, struct batch_worker *w, const char *job)
+{
+    char rom[1024];
+    snprintf(rom, sizeof(rom), "%s", job);
+    char *at = strrchr(rom, '@');
+    const char *script = NULL;
+    if (at) {
+        *at = '\0';
+        script = at + 1;
+    }
+
+    // A movie brings its own profile, seed and speed, so its input lands on the frames it was recorded on
+    struct chip_movie movie = { 0 };
+    if (script && !movie_read(&movie, script)) {
+        fprintf(stderr, "%s: not a movie, or from another version\n", script);
+        return false;
+    }
+    enum chip_quirks quirks = script ? (enum chip_quirks)movie.header.quirks : batch->quirks;
+    u32 ipf = script ? movie.header.ipf : batch->ipf;
+
+    struct chip8 chip;
+    chip_init(&chip);
+    if (!chip_set_quirks(&chip, quirks)) {
+        perror("chip_set_quirks");
+        chip_deinit(&chip);
+        movie_free(&movie);
+        return false;
+    }
+    enum chip_error err = chip_load(&chip, rom);
+    if (err != CHIP_OK) {
+        fprintf(stderr, "%s: %s\n", rom, chip_strerror(err));
+        chip_deinit(&chip);
+        movie_free(&movie);
+        return false;
+    }
+    if (script) {
+        if (movie_hash_mem(&chip) != movie.header.rom_hash) {
+            fprintf(stderr, "%s: recorded with a different program than %s\n", script, rom);
+            chip_deinit(&chip);
+            movie_free(&movie);
+            return false;
+        }
+        chip_seed(&chip, movie.header.seed);
+    }
+    chip.reference = batch->reference;
+
+    // 60Hz frames like the GUI, so timers run and delay loops end. Once the movie runs out the keys stay up.
+    // Only the interpreter itself is timed, loading is excluded
+    struct sched sched;
+    sched_init(&sched, ipf, true);
+    u32 run = 0, frame = 0;
+    u64 budget = 0;
+    double start = now_seconds();
+    while (budget < batch->cycles && !chip.halted) {
+        u16 keys = 0;
+        if (run < movie.header.run_count) {
+            keys = movie.runs[run].key_mask;
+            if (++frame == movie.runs[run].frames) {
+                run++;
+                frame = 0;
+            }
+        }
+        sched_frame(&sched, &chip, keys);
+        budget += sched.ipf;
+    }
+    w->seconds += now_seconds() - start;
+
+    // Idle skipping counts instructions against the budget without running them, they don't count as work here
+    u64 idle = 0;
+    if (chip.cache) {
+        w->block_insns += chip.cache->block_insns;
+        idle = chip.cache->idle_insns;
+    }
+    w->instructions += chip.insns - idle;
+    w->idle_insns += idle;
+    chip_deinit(&chip);
+    movie_free(&movie);
+    return true;
+}
+
+static void *batch_worker(void *arg)
+{
+    struct batch_worker *w = arg;
+    struct batch *batch = w->batch;
+
+    int job;
+    while ((job = next_job(batch)) >= 0) {
+        if (batch_job(batch, w, batch->roms[job]))
+            w->jobs++;
+        else
+            w->failed++;
+    }
+
+    return NULL;
+}
+
+int batch_main(const char **roms, int count, u64 cycles, u32 ipf, int workers, bool reference,
+               enum chip_quirks quirks)
+{
+    if (workers <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = cores > 0 ? (int)cores : 1;
+    }
+    if (workers > count)
+        workers = count;
+
+    struct batch batch = {
+        .roms = roms,
+        .count = count,
+        .cycles = cycles,
+        .ipf = ipf,
+        .reference = reference,
+        .quirks = quirks,
+        .next = 0,
+    };
+    pthread_mutex_init(&batch.lock, NULL);
+
+    struct batch_worker *pool = calloc(workers, sizeof(*pool));
+    if (!pool) {
+        perror("calloc");
+        return 1;
+    }
+
+    double start = now_seconds();
+    int started = 0;
+    for (; started < workers; started++) {
+        pool[started].batch = &batch;
+        if (pthread_create(&pool[started].thread, NULL, batch_worker, &pool[started]) != 0) {
+            perror("pthread_create");
+            break;
+        }
+    }
+    for (int i = 0; i < started; i++)
+        pthread_join(pool[i].thread, NULL);
+    double wall = now_seconds() - start;
+
+    u64 total = 0, in_blocks = 0, idle = 0;
+    int jobs = 0, failed = 0;
+    for (int i = 0; i < started; i++) {
+        struct batch_worker *w = &pool[i];
+        double ips = w->seconds > 0 ? w->instructions / w->seconds : 0;
+        printf("worker %d: %d jobs, %llu instructions, %.3fs, %.0f instructions/sec\n",
+               i, w->jobs, (unsigned long long)w->instructions, w->seconds, ips);
+        total += w->instructions;
+        in_blocks += w->block_insns;
+        idle += w->idle_insns;
+        jobs += w->jobs;
+        failed += w->failed;
+    }
+    printf("total: %d jobs on %d workers, %d failed, %llu instructions, %.3fs wall, %.0f instructions/sec, "
+           "%.1f%% in blocks, %.1f%% of the budget skipped idle\n",
+           jobs, started, failed, (unsigned long long)total, wall, wall > 0 ? total / wall : 0,
+           total > 0 ? 100.0 * in_blocks / total : 0, total + idle > 0 ? 100.0 * idle / (total + idle) : 0);
+
+    free(pool);
+    pthread_mutex_destroy(&batch.lock);
+    return started == workers && failed == 0 ? 0 : 1;
+}
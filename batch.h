@@ -0,0 +1,11 @@
+#pragma once
+#include "chip8.h"
+
+// Headless batch mode: runs every job in `jobs` as its own CHIP-8 instance for `cycles` instructions, in 60Hz frames of
+// `ipf` with the timers ticking like the GUI, spread over `workers` threads (0 means one per online core). A job is a ROM
+// path, or ROM@MOVIE to feed it the keys of a movie recorded with -R (which also brings its own profile, seed and speed).
+// Prints per-worker and total instructions/sec, counting only instructions actually run.
+// `reference` runs the plain chip_cycle interpreter instead of the decoded one, `quirks` picks the profile for jobs
+// without a movie. Returns 0 on success, non-zero if any job failed or the worker threads couldn't be started
+int batch_main(const char **jobs, int count, u64 cycles, u32 ipf, int workers, bool reference,
+               enum chip_quirks quirks);
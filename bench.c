@@ -0,0 +1,419 @@
+#define _POSIX_C_SOURCE 200809L
+#include "chip8.h"
+#include "lanes.h"
+#include "state.h"
+#include <dirent.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Benchmark harness for the interpreter: runs synthetic opcode-mix ROMs plus every .ch8 in the given directories
+// through chip_cycle, chip_run and the lockstep lanes and prints one tab-separated line per (rom, mode) so runs can be diffed.
+// A few known-answer checks run first, then every ROM is run side by side through each mode and has to leave exactly
+// the machine chip_cycle does. Either one failing stops it with an error before anything is timed
+
+#define BENCH_IPF    100   // Instructions per frame, like a frontend would run per 60Hz tick
+#define BENCH_FRAMES 20000 // Frames per timed repetition
+#define BENCH_WARMUP 2     // Untimed repetitions before measuring
+#define BENCH_REPS   10    // Timed repetitions
+#define BENCH_LANES  256   // Machines in the lockstep run, which gets BENCH_FRAMES / BENCH_LANES frames each
+#define SAME_FRAMES  600   // Frames each ROM runs for in the state comparison
+#define SAME_LANES   16
+
+enum bench_mode { BENCH_REFERENCE, BENCH_DECODED, BENCH_LOCKSTEP, BENCH_MODES };
+
+struct bench_rom {
+    char name[64];
+    u8 data[0x1000 - 0x200];
+    size_t size;
+};
+
+// Synthetic ROMs, each one a tight loop hammering one class of opcode
+static const u16 rom_alu[] = {
+    0x6013, 0x6137, 0x62F0,
+    0x8014, 0x8125, 0x8206, 0x8017, 0x810E, 0x8201, 0x8012, 0x8123, 0x8210, 0x7001, 0x7103,
+    0x8014, 0x8125, 0x8206, 0x8017, 0x810E, 0x8201, 0x8012, 0x8123, 0x8210, 0x7001, 0x7103,
+    0x1206,
+};
+static const u16 rom_draw[] = {
+    0x6000, 0x6100, 0xF029,
+    0xD015, 0x7009, 0x7103, 0xD01F, 0x7005, 0x7101, 0xD018,
+    0x1206,
+};
+static const u16 rom_mem[] = {
+    0xA300, 0x6063, 0x6ABC,
+    0xF033, 0xF265, 0xFF55, 0xFF65, 0xFA33, 0xF565, 0x7001,
+    0x1206,
+};
+static const u16 rom_call[] = {
+    0x220A, 0x2210, 0x220A, 0x2210, 0x1200,
+    0x7001, 0x2214, 0x00EE,
+    0x7101, 0x00EE,
+    0x7201, 0x00EE,
+};
+static const u16 rom_skip[] = {
+    0x6005, 0x6105,
+    0x3005, 0x6000, 0x4006, 0x6000, 0x5010, 0x6000, 0x9010, 0x6000, 0x3105, 0x6100, 0xE09E, 0x6000, 0xE0A1, 0x6000,
+    0x1204,
+};
+// Only checked, not timed: it waits on the delay timer, which chip_run jumps over rather than runs
+static const u16 rom_wait[] = {
+    0x6003, 0xF015,
+    0xF107, 0x3100, 0x1204,
+    0x7201, 0x1200,
+};
+
+// Checked before anything is timed, a fast wrong answer isn't worth benchmarking. Each runs `cycles` instructions
+// under both interpreters and has to leave i at `i`
+struct bench_check {
+    const char *name;
+    enum chip_quirks quirks;
+    const u16 *words;
+    size_t count;
+    u32 cycles;
+    u16 i;
+};
+
+static const u16 check_addi_wrap[] = { 0x6001, 0xAFFF, 0xF01E }; // Classic i stays 12 bits
+static const u16 check_xo_addi[] = { 0x6001, 0xF000, 0x2345, 0xF01E }; // XO-CHIP keeps what F000 NNNN loaded
+
+static const struct bench_check checks[] = {
+    { "addi-wrap", QUIRKS_DEFAULT, check_addi_wrap, 3, 3, 0x000 },
+    { "xo-long-i-addi", QUIRKS_XO, check_xo_addi, 4, 3, 0x2346 },
+};
+
+static void rom_from_words(struct bench_rom *rom, const char *name, const u16 *words, size_t count)
+{
+    snprintf(rom->name, sizeof(rom->name), "%s", name);
+    for (size_t i = 0; i < count; i++) {
+        rom->data[i*2]   = words[i] >> 8;
+        rom->data[i*2+1] = words[i] & 0xFF;
+    }
+    rom->size = count * 2;
+}
+
+static bool rom_from_file(struct bench_rom *rom, const char *dir, const char *file)
+{
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", dir, file);
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    snprintf(rom->name, sizeof(rom->name), "%s", file);
+    rom->size = fread(rom->data, 1, sizeof(rom->data), f);
+    fclose(f);
+    return true;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// The same number of instructions spread over BENCH_LANES machines in lockstep, ns per instruction of any lane
+static double bench_lanes(const struct bench_rom *rom)
+{
+    struct chip_rom *image = chip_rom_wrap(rom->data, rom->size);
+    struct chip_lanes *lanes = lanes_new(BENCH_LANES, QUIRKS_DEFAULT);
+    if (!image || !lanes) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    lanes_load_rom(lanes, image);
+
+    double start = now_ns();
+    for (int f = 0; f < BENCH_FRAMES / BENCH_LANES; f++)
+        lanes_run(lanes, NULL, BENCH_IPF);
+    double elapsed = now_ns() - start;
+
+    double insns = lanes->insns;
+    lanes_free(lanes);
+    chip_rom_close(image);
+    return elapsed / insns;
+}
+
+// One repetition from a fresh machine, returns ns per instruction
+static double bench_once(const struct bench_rom *rom, enum bench_mode mode)
+{
+    if (mode == BENCH_LOCKSTEP)
+        return bench_lanes(rom);
+
+    struct chip8 chip;
+    memset(&chip, 0, sizeof(chip));
+    chip_init(&chip);
+    chip.rng = 0xC8C8C8C8; // Same CXNN sequence every time
+    chip_load_mem(&chip, rom->data, rom->size);
+    chip.reference = mode == BENCH_REFERENCE;
+
+    double start = now_ns();
+    for (int f = 0; f < BENCH_FRAMES; f++)
+        chip_run(&chip, 0, 0, BENCH_IPF);
+    double elapsed = now_ns() - start;
+
+    chip_deinit(&chip);
+    return elapsed / ((double)BENCH_FRAMES * BENCH_IPF);
+}
+
+static bool bench_checks(void)
+{
+    static struct bench_rom rom;
+    bool ok = true;
+    for (size_t c = 0; c < sizeof(checks) / sizeof(checks[0]); c++) {
+        rom_from_words(&rom, checks[c].name, checks[c].words, checks[c].count);
+        for (int reference = 0; reference < 2; reference++) {
+            struct chip8 chip;
+            memset(&chip, 0, sizeof(chip));
+            chip_init(&chip);
+            if (!chip_set_quirks(&chip, checks[c].quirks)) {
+                fprintf(stderr, "Out of memory\n");
+                exit(1);
+            }
+            chip_load_mem(&chip, rom.data, rom.size);
+            chip.reference = reference;
+            chip_run(&chip, 0, 0, checks[c].cycles);
+            if (chip.i != checks[c].i) {
+                fprintf(stderr, "check %s (%s): i is 0x%04X, expected 0x%04X\n", checks[c].name,
+                        reference ? "reference" : "decoded", chip.i, checks[c].i);
+                ok = false;
+            }
+            chip_deinit(&chip);
+        }
+    }
+    return ok;
+}
+
+static const char *quirk_names[QUIRKS_COUNT] = { "default", "chip8", "schip", "xochip" };
+
+// Keys, budget and timing for frame f of the state comparison. Varied so every path gets taken: FX0A and EX9E/EXA1
+// with and without keys, blocks and delay loops cut short by the budget, timers driven by deltatime and by chip_tick
+static u16 same_keys(int f)
+{
+    return (f / 40) % 3 == 2 ? 1 << (f % 16) : 0;
+}
+
+static u32 same_cycles(int f)
+{
+    return 1 + (f * 37) % 97;
+}
+
+static u16 same_deltatime(int f)
+{
+    return (f / 100) % 2;
+}
+
+// Name of the first field two snapshots differ in
+static const char *state_diff(const struct chip_state *a, const struct chip_state *b)
+{
+#define FIELD(f) { #f, offsetof(struct chip_state, f) }
+    static const struct { const char *name; size_t offset; } fields[] = {
+        FIELD(display), FIELD(display2), FIELD(stack), FIELD(pc), FIELD(i), FIELD(timer), FIELD(rng),
+        FIELD(mem_size), FIELD(v), FIELD(rpl), FIELD(pattern), FIELD(sp), FIELD(delay), FIELD(sound), FIELD(hires),
+        FIELD(halted), FIELD(planes), FIELD(pitch), FIELD(pattern_loaded), FIELD(mem),
+    };
+#undef FIELD
+    const u8 *pa = (const u8 *)a, *pb = (const u8 *)b;
+    size_t k = 0;
+    while (k < chip_state_size(a) && pa[k] == pb[k])
+        k++;
+    const char *name = "header";
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++)
+        if (fields[f].offset <= k)
+            name = fields[f].name;
+    return name;
+}
+
+static void same_init(struct chip8 *chip, const struct bench_rom *rom, enum chip_quirks quirks, u32 seed)
+{
+    memset(chip, 0, sizeof(*chip));
+    chip_init(chip);
+    if (!chip_set_quirks(chip, quirks)) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    chip_load_mem(chip, rom->data, rom->size);
+    chip_seed(chip, seed);
+}
+
+// chip_run through the decoded cache (blocks, in-block skips, idle loops) against chip_cycle one at a time
+static bool bench_same_decoded(const struct bench_rom *rom, enum chip_quirks quirks)
+{
+    static struct chip_state want, got;
+    struct chip8 ref, dec;
+    same_init(&ref, rom, quirks, 0xC8C8C8C8);
+    same_init(&dec, rom, quirks, 0xC8C8C8C8);
+    ref.reference = true;
+
+    bool ok = true;
+    for (int f = 0; f < SAME_FRAMES && ok; f++) {
+        u16 keys = same_keys(f), deltatime = same_deltatime(f);
+        u32 cycles = same_cycles(f);
+        bool ref_redraw = chip_run(&ref, keys, deltatime, cycles);
+        bool dec_redraw = chip_run(&dec, keys, deltatime, cycles);
+        if (!deltatime) {
+            chip_tick(&ref);
+            chip_tick(&dec);
+        }
+
+        chip_save(&ref, &want);
+        chip_save(&dec, &got);
+        if (memcmp(&want, &got, chip_state_size(&want)) != 0 || ref_redraw != dec_redraw) {
+            fprintf(stderr, "check %s (decoded, %s): frame %d differs from reference in %s (pc 0x%03X, expected 0x%03X)\n",
+                    rom->name, quirk_names[quirks], f, ref_redraw != dec_redraw ? "redraw" : state_diff(&want, &got),
+                    got.pc, want.pc);
+            ok = false;
+        }
+    }
+    chip_deinit(&ref);
+    chip_deinit(&dec);
+    return ok;
+}
+
+// Every lane against its own reference machine, with its own keys and CXNN seed
+static bool bench_same_lanes(const struct bench_rom *rom, enum chip_quirks quirks)
+{
+    static struct chip_state want, got;
+    static struct chip8 ref[SAME_LANES];
+    struct chip8 lane;
+    struct chip_rom *image = chip_rom_wrap(rom->data, rom->size);
+    struct chip_lanes *lanes = lanes_new(SAME_LANES, quirks);
+    if (!image || !lanes) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    lanes_load_rom(lanes, image);
+    for (u32 l = 0; l < SAME_LANES; l++) {
+        same_init(&ref[l], rom, quirks, l + 1);
+        ref[l].reference = true;
+    }
+    same_init(&lane, rom, quirks, 0);
+
+    bool ok = true;
+    u16 keys[SAME_LANES];
+    for (int f = 0; f < SAME_FRAMES && ok; f++) {
+        u32 cycles = same_cycles(f);
+        for (u32 l = 0; l < SAME_LANES; l++) {
+            keys[l] = same_keys(f + l*7);
+            chip_run(&ref[l], keys[l], 0, cycles);
+            chip_tick(&ref[l]);
+        }
+        lanes_run(lanes, keys, cycles);
+        lanes_tick(lanes);
+
+        for (u32 l = 0; l < SAME_LANES && ok; l++) {
+            lanes_get(lanes, l, &lane);
+            chip_save(&ref[l], &want);
+            chip_save(&lane, &got);
+            if (memcmp(&want, &got, chip_state_size(&want)) != 0) {
+                fprintf(stderr, "check %s (lockstep, %s): lane %u frame %d differs from reference in %s (pc 0x%03X, expected 0x%03X)\n",
+                        rom->name, quirk_names[quirks], l, f, state_diff(&want, &got), got.pc, want.pc);
+                ok = false;
+            }
+        }
+    }
+
+    for (u32 l = 0; l < SAME_LANES; l++)
+        chip_deinit(&ref[l]);
+    chip_deinit(&lane);
+    lanes_free(lanes);
+    chip_rom_close(image);
+    return ok;
+}
+
+// Same end state from every mode under every profile the mode supports
+static bool bench_same(const struct bench_rom *rom)
+{
+    bool ok = true;
+    for (int q = 0; q < QUIRKS_COUNT; q++) {
+        ok &= bench_same_decoded(rom, q);
+        if (q == QUIRKS_DEFAULT || q == QUIRKS_CHIP8)
+            ok &= bench_same_lanes(rom, q);
+    }
+    return ok;
+}
+
+static void bench_rom(const struct bench_rom *rom)
+{
+    static const char *modes[] = { "reference", "decoded", "lockstep" };
+    for (int m = 0; m < BENCH_MODES; m++) {
+        for (int w = 0; w < BENCH_WARMUP; w++)
+            bench_once(rom, m);
+
+        double ns[BENCH_REPS], mean = 0, var = 0;
+        for (int r = 0; r < BENCH_REPS; r++) {
+            ns[r] = bench_once(rom, m);
+            mean += ns[r];
+        }
+        mean /= BENCH_REPS;
+        for (int r = 0; r < BENCH_REPS; r++)
+            var += (ns[r] - mean) * (ns[r] - mean);
+        double stddev = sqrt(var / (BENCH_REPS - 1));
+
+        printf("%s\t%s\t%d\t%d\t%.3f\t%.3f\t%.1f\t%.0f\n", rom->name, modes[m], BENCH_IPF, BENCH_FRAMES * BENCH_REPS,
+               mean, stddev, 100.0 * stddev / mean, 1e9 / (mean * BENCH_IPF));
+        fflush(stdout);
+    }
+}
+
+// Append a ROM to the list, growing it as needed
+static struct bench_rom *rom_add(struct bench_rom **roms, int *count)
+{
+    struct bench_rom *grown = realloc(*roms, (*count + 1) * sizeof(**roms));
+    if (!grown) {
+        fprintf(stderr, "Out of memory\n");
+        exit(1);
+    }
+    *roms = grown;
+    return &grown[(*count)++];
+}
+
+int main(int argc, char **argv)
+{
+    struct bench_rom *roms = NULL;
+    int count = 0;
+
+    rom_from_words(rom_add(&roms, &count), "synthetic-alu", rom_alu, sizeof(rom_alu) / sizeof(u16));
+    rom_from_words(rom_add(&roms, &count), "synthetic-draw", rom_draw, sizeof(rom_draw) / sizeof(u16));
+    rom_from_words(rom_add(&roms, &count), "synthetic-mem", rom_mem, sizeof(rom_mem) / sizeof(u16));
+    rom_from_words(rom_add(&roms, &count), "synthetic-call", rom_call, sizeof(rom_call) / sizeof(u16));
+    rom_from_words(rom_add(&roms, &count), "synthetic-skip", rom_skip, sizeof(rom_skip) / sizeof(u16));
+
+    // Every .ch8 file in the directories given on the command line
+    for (int a = 1; a < argc; a++) {
+        DIR *dir = opendir(argv[a]);
+        if (!dir) {
+            perror(argv[a]);
+            continue;
+        }
+        struct dirent *ent;
+        while ((ent = readdir(dir))) {
+            size_t len = strlen(ent->d_name);
+            if (len < 4 || strcmp(&ent->d_name[len-4], ".ch8") != 0)
+                continue;
+            if (!rom_from_file(rom_add(&roms, &count), argv[a], ent->d_name))
+                count--;
+        }
+        closedir(dir);
+    }
+
+    static struct bench_rom wait;
+    rom_from_words(&wait, "wait-delay", rom_wait, sizeof(rom_wait) / sizeof(u16));
+    bool ok = bench_checks() && bench_same(&wait);
+    for (int r = 0; r < count; r++)
+        ok &= bench_same(&roms[r]);
+    if (!ok)
+        return 1;
+
+    printf("rom\tmode\tipf\tframes\tns_per_insn\tstddev_ns\tstddev_pct\tframes_per_sec\n");
+    for (int r = 0; r < count; r++)
+        bench_rom(&roms[r]);
+
+    free(roms);
+    return 0;
+}
@@ -1,8 +1,17 @@
+#define _POSIX_C_SOURCE 200809L
 #include "chip8.h"
+#include "profile.h"
+#include "trace.h"
+#include "aot.h"
 #include <time.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 const u16 font_addr = 0x050;
 const u8 font[] = {
@@ -24,293 +33,1067 @@ const u8 font[] = {
     0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
+const u16 font_big_addr = 0x0A0;
+const u8 font_big[] = {
+    0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+    0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+    0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+    0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+    0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+    0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+    0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+    0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C, // 9
+    0x3C, 0x7E, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFE, 0xC3, 0xC3, 0xFE, 0xFE, 0xC3, 0xC3, 0xFE, 0xFC, // B
+    0x3C, 0x7E, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0x7E, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFC, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFC, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
+// Point the page table at the inline pages, the classic 4KB
+static void chip_pages_small(struct chip8 *chip)
+{
+    for (int k = 0; k < 0x1000 / CHIP_PAGE_SIZE; k++) {
+        chip->pages_small[k].refs = 0;
+        chip->pages[k] = &chip->pages_small[k];
+    }
+    chip->pages_big = NULL;
+    chip->mem_mask = 0xFFF;
+}
+
+// Drop this machine's use of its pages. Built-in ones (refs 0) go with the machine, shared ones with the last user
+static void chip_pages_release(struct chip8 *chip)
+{
+    for (u32 k = 0; k < (chip->mem_mask + 1u) >> CHIP_PAGE_SHIFT; k++)
+        if (chip->pages[k]->refs && --chip->pages[k]->refs == 0)
+            free(chip->pages[k]);
+    free(chip->pages_big);
+    chip->pages_big = NULL;
+}
+
+static void chip_cache_release(struct chip8 *chip)
+{
+    if (chip->cache && --chip->cache->refs == 0)
+        free(chip->cache);
+    chip->cache = NULL;
+}
+
 void chip_init(struct chip8 *chip)
 {
+    chip_pages_small(chip);
     chip->pc = 0x200;
+    chip->i = 0;
     chip->sp = 0;
+    memset(chip->stack, 0x00, sizeof(chip->stack));
     chip->delay = 0;
     chip->sound = 0;
     chip->timer = 0;
-    chip->debug = false;
+    chip->reference = false;
+    chip->quirks = QUIRKS_DEFAULT;
+    chip->idle = CHIP_IDLE_NONE;
+    chip->insns = 0;
+    chip->draws = 0;
+    chip->cache = NULL;
+    chip->trace = NULL;
+    chip->aot = NULL;
+    chip->aot_lo = chip->aot_hi = 0;
+#ifdef CHIP_PROFILER
+    chip->profile = NULL;
+#endif
 
-    srand(time(NULL));
-    memcpy(&chip->mem[font_addr], font, sizeof(font));
+    // Mix in the address so instances created in the same second still diverge
+    chip_seed(chip, (u32)time(NULL) ^ (u32)(uintptr_t)chip);
+
+    // Programs can read memory they never wrote, replays need that to be the same every run
+    for (int k = 0; k < 0x1000 / CHIP_PAGE_SIZE; k++)
+        memset(chip->pages_small[k].data, 0x00, CHIP_PAGE_SIZE);
+    chip_mem_write(chip, font_addr, font, sizeof(font));
+    chip_mem_write(chip, font_big_addr, font_big, sizeof(font_big));
     memset(chip->display, 0x00, sizeof(chip->display));
+    memset(chip->display2, 0x00, sizeof(chip->display2));
+    chip->planes = 1;
+    chip->dirty = DISPLAY_ALL_ROWS;
+    chip->hires = false;
+    chip->halted = false;
     memset(chip->v, 0x00, sizeof(chip->v));
+    memset(chip->rpl, 0x00, sizeof(chip->rpl));
+    memset(chip->pattern, 0x00, sizeof(chip->pattern));
+    chip->pattern_loaded = false;
+    chip->pitch = 64;
+}
+
+void chip_deinit(struct chip8 *chip)
+{
+    chip_cache_release(chip);
+    chip_pages_release(chip);
+    chip_pages_small(chip);
 }
 
-void chip_load(struct chip8 *chip, const char *program)
+bool chip_set_quirks(struct chip8 *chip, enum chip_quirks quirks)
 {
-    FILE *f = fopen(program, "rb");
-    if (!f) {
-        perror("fopen");
-        exit(1);
+    bool big = (quirks == QUIRKS_XO);
+    if (big != (chip->mem_mask == 0xFFFF)) {
+        u8 low[0x1000];
+        chip_mem_read(chip, 0, low, sizeof(low));
+        if (big) {
+            struct chip_page *pages = calloc(CHIP_PAGES_MAX, sizeof(*pages));
+            if (!pages)
+                return false;
+            chip_pages_release(chip);
+            for (int k = 0; k < CHIP_PAGES_MAX; k++)
+                chip->pages[k] = &pages[k];
+            chip->pages_big = pages;
+            chip->mem_mask = 0xFFFF;
+        }
+        else {
+            chip_pages_release(chip);
+            chip_pages_small(chip);
+        }
+
+        // The decoded cache is sized to memory, the next chip_run makes a new one
+        chip_cache_release(chip);
+        chip_mem_write(chip, 0, low, sizeof(low));
     }
+    chip->quirks = quirks;
+    return true;
+}
 
-    fseek(f, 0, SEEK_END);
-    size_t size = ftell(f);
-    rewind(f);
-    fread(&chip->mem[0x200], 1, size, f);
 
-    fclose(f);
+struct chip8 *chip_new(enum chip_quirks quirks, u32 seed)
+{
+    struct chip8 *chip = malloc(sizeof(*chip));
+    if (!chip)
+        return NULL;
+    chip_init(chip);
+    chip_seed(chip, seed);
+    if (!chip_set_quirks(chip, quirks)) {
+        free(chip);
+        return NULL;
+    }
+    return chip;
 }
 
-bool chip_cycle(struct chip8 *chip, u16 key_mask, u16 deltatime)
+void chip_free(struct chip8 *chip)
 {
-    // Fetch
-    u16 instruction = (chip->mem[chip->pc & 0xFFF] << 8) | chip->mem[(chip->pc+1) & 0xFFF];
-    chip->pc += 2;
-    chip->pc &= 0xFFF; // Bound to 12 bits
-
-    // Decode
-    u16 opcode = (instruction >> 12);
-    u16  x     = (instruction >> 8) & 0x0F;
-    u16   y    = (instruction >> 4) & 0x0F;
-    u16    n   = instruction & 0x000F;
-    u16   nn   = instruction & 0x00FF;
-    u16  nnn   = instruction & 0x0FFF;
-
-    if (chip->debug) printf("(%03d) Executing instruction %#06X\n", (int)chip->pc, instruction);
-    
-    // Execute
-    u8 *v = chip->v; // Convenience
-    bool redraw = false;
-    switch (opcode) {
-        case 0x0:
-            switch (instruction) {
-                case 0x00E0:
-                    // Clear screen
-                    memset(chip->display, 0x00, sizeof(chip->display));
-                    redraw = true;
-                    break;
-                case 0x00EE:
-                    // Return from subroutine
-                    chip->pc = chip->stack[--chip->sp];
-                    break;
+    if (!chip)
+        return;
+    chip_deinit(chip);
+    free(chip);
+}
+
+enum chip_error chip_load_mem(struct chip8 *chip, const u8 *program, size_t size)
+{
+    if (size > chip->mem_mask + 1u - 0x200)
+        return CHIP_ERR_TOO_BIG;
+    chip_mem_write(chip, 0x200, program, size);
+    chip->aot = chip_aot_find(program, size, chip->quirks);
+    chip->aot_lo = chip->aot_hi = 0;
+    return CHIP_OK;
+}
+
+enum chip_error chip_load_rom(struct chip8 *chip, const struct chip_rom *rom)
+{
+    return chip_load_mem(chip, rom->data, rom->size);
+}
+
+enum chip_error chip_load(struct chip8 *chip, const char *program)
+{
+    enum chip_error err;
+    struct chip_rom *rom = chip_rom_open(program, &err);
+    if (!rom)
+        return err;
+    err = chip_load_rom(chip, rom);
+    chip_rom_close(rom);
+    return err;
+}
+
+struct chip_rom *chip_rom_open(const char *path, enum chip_error *err)
+{
+    struct chip_rom *rom = malloc(sizeof(*rom));
+    if (!rom) {
+        *err = CHIP_ERR_NOMEM;
+        return NULL;
+    }
+
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        *err = CHIP_ERR_IO;
+        goto fail;
+    }
+    if (st.st_size > 0x10000 - 0x200) {
+        *err = CHIP_ERR_TOO_BIG;
+        goto fail;
+    }
+
+    // mmap refuses empty files, an empty program is still a (useless) valid one
+    rom->size = st.st_size;
+    rom->mapped = rom->size > 0;
+    rom->data = NULL;
+    if (rom->mapped) {
+        void *data = mmap(NULL, rom->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            *err = CHIP_ERR_IO;
+            goto fail;
+        }
+        rom->data = data;
+    }
+    close(fd);
+    *err = CHIP_OK;
+    return rom;
+
+fail:
+    if (fd >= 0) {
+        int saved = errno; // Keep the interesting errno for the caller's perror
+        close(fd);
+        errno = saved;
+    }
+    free(rom);
+    return NULL;
+}
+
+struct chip_rom *chip_rom_wrap(const u8 *data, size_t size)
+{
+    struct chip_rom *rom = malloc(sizeof(*rom));
+    if (!rom)
+        return NULL;
+    rom->data = data;
+    rom->size = size;
+    rom->mapped = false;
+    return rom;
+}
+
+void chip_rom_close(struct chip_rom *rom)
+{
+    if (!rom)
+        return;
+    if (rom->mapped)
+        munmap((void *)rom->data, rom->size);
+    free(rom);
+}
+
+const char *chip_strerror(enum chip_error err)
+{
+    switch (err) {
+        case CHIP_OK: return "Success";
+        case CHIP_ERR_IO: return strerror(errno);
+        case CHIP_ERR_TOO_BIG: return "Program too big for memory";
+        case CHIP_ERR_NOMEM: return "Out of memory";
+    }
+    return "Unknown error";
+}
+
+void chip_seed(struct chip8 *chip, u32 seed)
+{
+    chip->rng = seed ? seed : 1; // xorshift never leaves 0
+}
+
+// xorshift32, top byte is the best mixed
+static inline u8 chip_rand(struct chip8 *chip)
+{
+    u32 r = chip->rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    chip->rng = r;
+    return r >> 24;
+}
+
+void chip_tick(struct chip8 *chip)
+{
+    if (chip->delay != 0) chip->delay--;
+    if (chip->sound != 0) chip->sound--;
+}
+
+// Move emulated time forward by `ms`, ticking the timers at exactly 60Hz
+static inline void chip_advance(struct chip8 *chip, u32 ms)
+{
+    chip->timer += ms * 60;
+    while (chip->timer >= 1000) {
+        chip->timer -= 1000;
+        chip_tick(chip);
+    }
+}
+
+// chip_advance for a long stretch of time at once, `units` being ms*60
+static void chip_advance_units(struct chip8 *chip, u64 units)
+{
+    u64 total = chip->timer + units;
+    u64 ticks = total / 1000;
+    chip->timer = total % 1000;
+    chip->delay = ticks < chip->delay ? chip->delay - ticks : 0;
+    chip->sound = ticks < chip->sound ? chip->sound - ticks : 0;
+}
+
+// Sprite row r as the top bits of a long: one byte per row, or two for the 16x16 DXY0 sprites. `mask` is the
+// interpreter's address mask, a constant like `wide`
+static inline u64 chip_sprite_row(const struct chip8 *chip, u16 addr, u16 mask, int r, bool wide)
+{
+    if (wide)
+        return (u64)((CHIP_MEM(chip, (addr + 2*r) & mask) << 8) | CHIP_MEM(chip, (addr + 2*r + 1) & mask)) << 48;
+    return (u64)CHIP_MEM(chip, (addr + r) & mask) << 56;
+}
+
+// DXYN without the per-pixel loop: each sprite byte is rotated into place as a 64-bit row mask, collisions are one AND
+// and the draw is one XOR per row. Wraps horizontally (or clips, if `clip`) and clips at the bottom, bit-for-bit like
+// drawing pixel by pixel. `wide` and `clip` are always constants, so each caller gets its own copy without the branches
+static inline u8 chip_draw(struct chip8 *chip, u64 *plane, u16 addr, u16 mask, u8 sx, u8 sy, u8 n, bool wide, bool clip)
+{
+    int rows = n;
+    if (sy + rows > DISPLAY_H)
+        rows = DISPLAY_H - sy;
+
+    // Build every row mask first, so the display pass below is a plain loop over consecutive words that vectorizes
+    u64 masks[16];
+    u64 dirty = 0;
+    for (int r = 0; r < rows; r++) {
+        u64 sprite = chip_sprite_row(chip, addr, mask, r, wide);
+        if (clip)
+            masks[r] = sprite >> sx;
+        else
+            masks[r] = sx ? (sprite >> sx) | (sprite << (64 - sx)) : sprite;
+        dirty |= (u64)(masks[r] != 0) << (sy + r); // XORing a non-empty mask always changes the row
+    }
+    chip->dirty |= dirty;
+
+    u64 hit = 0;
+    u64 *display = &plane[sy];
+    for (int r = 0; r < rows; r++) {
+        hit |= display[r] & masks[r];
+        display[r] ^= masks[r];
+    }
+    return hit != 0;
+}
+
+// Same thing on the 128x64 hi-res display, where a row mask is a pair of longs. A sprite starting in the right half can
+// spill past x=127, which either wraps into the left long or is dropped
+static inline u8 chip_draw_hires(struct chip8 *chip, u64 *plane, u16 addr, u16 mask, u8 sx, u8 sy, u8 n, bool wide,
+                                 bool clip)
+{
+    int rows = n;
+    if (sy + rows > DISPLAY_HI_H)
+        rows = DISPLAY_HI_H - sy;
+
+    u64 masks[16][2];
+    u64 dirty = 0;
+    for (int r = 0; r < rows; r++) {
+        u64 sprite = chip_sprite_row(chip, addr, mask, r, wide);
+        if (sx < 64) {
+            masks[r][0] = sprite >> sx;
+            masks[r][1] = sx ? sprite << (64 - sx) : 0;
+        }
+        else {
+            u8 s = sx - 64;
+            masks[r][1] = sprite >> s;
+            masks[r][0] = (clip || s == 0) ? 0 : sprite << (64 - s);
+        }
+        dirty |= (u64)((masks[r][0] | masks[r][1]) != 0) << (sy + r);
+    }
+    chip->dirty |= dirty;
+
+    u64 hit = 0;
+    u64 *display = &plane[2*sy];
+    for (int r = 0; r < rows; r++) {
+        hit |= (display[2*r] & masks[r][0]) | (display[2*r + 1] & masks[r][1]);
+        display[2*r] ^= masks[r][0];
+        display[2*r + 1] ^= masks[r][1];
+    }
+    return hit != 0;
+}
+
+// Bitplane p if it's selected, NULL otherwise. Only XO-CHIP's FN01 ever selects anything but plane 0
+static inline u64 *chip_plane(struct chip8 *chip, int p)
+{
+    if (!(chip->planes & (1 << p)))
+        return NULL;
+    return p ? chip->display2 : chip->display;
+}
+
+// 00E0, only touching the part of the selected planes the current mode uses
+static inline void chip_clear(struct chip8 *chip)
+{
+    size_t size = chip->hires ? sizeof(chip->display) : DISPLAY_H * sizeof(u64);
+    for (int p = 0; p < 2; p++) {
+        u64 *d = chip_plane(chip, p);
+        if (d)
+            memset(d, 0x00, size);
+    }
+    chip->dirty = CHIP_ALL_ROWS(chip);
+}
+
+// 00FE/00FF. The two layouts share the arrays, so the switch starts from a blank screen on both planes
+static void chip_set_hires(struct chip8 *chip, bool hires)
+{
+    memset(chip->display, 0x00, sizeof(chip->display));
+    memset(chip->display2, 0x00, sizeof(chip->display2));
+    chip->hires = hires;
+    chip->dirty = CHIP_ALL_ROWS(chip);
+}
+
+// 00CN/00DN: scroll the selected planes down (or up) n rows of the current resolution. Rows are whole longs, so each
+// plane is one memmove
+static void chip_scroll_vertical(struct chip8 *chip, u8 n, bool down)
+{
+    size_t row = chip->hires ? 2 : 1;
+    int h = CHIP_H(chip);
+    if (n > h)
+        n = h;
+    for (int p = 0; p < 2; p++) {
+        u64 *d = chip_plane(chip, p);
+        if (!d)
+            continue;
+        if (down) {
+            memmove(&d[n * row], d, (h - n) * row * sizeof(u64));
+            memset(d, 0x00, n * row * sizeof(u64));
+        }
+        else {
+            memmove(d, &d[n * row], (h - n) * row * sizeof(u64));
+            memset(&d[(h - n) * row], 0x00, n * row * sizeof(u64));
+        }
+    }
+    chip->dirty = CHIP_ALL_ROWS(chip);
+}
+
+// 00FB: scroll right 4 pixels, a shift per long plus the 4 bits carried from the left long to the right one in hi-res
+static void chip_scroll_right(struct chip8 *chip)
+{
+    for (int p = 0; p < 2; p++) {
+        u64 *d = chip_plane(chip, p);
+        if (!d)
+            continue;
+        if (chip->hires) {
+            for (int y = 0; y < DISPLAY_HI_H; y++) {
+                d[2*y + 1] = (d[2*y + 1] >> 4) | (d[2*y] << 60);
+                d[2*y] >>= 4;
             }
-            break;
-        case 0x1:
-            // 1NNN: Jump to 0xNNN
-            chip->pc = nnn;
-            break;
-        case 0x2:
-            // 2NNN: Call subroutine at 0xNNN
-            chip->stack[chip->sp++] = chip->pc;
-            chip->pc = nnn;
-            break;
-        case 0x3:
-            // 3XNN: Skip next if vX == NN
-            if (v[x] == nn)
-                chip->pc += 2;
-            break;
-        case 0x4:
-            // 4XNN: Skip next if vX != NN
-            if (v[x] != nn)
-                chip->pc += 2;
-            break;
+        }
+        else {
+            for (int y = 0; y < DISPLAY_H; y++)
+                d[y] >>= 4;
+        }
+    }
+    chip->dirty = CHIP_ALL_ROWS(chip);
+}
+
+// 00FC: scroll left 4 pixels
+static void chip_scroll_left(struct chip8 *chip)
+{
+    for (int p = 0; p < 2; p++) {
+        u64 *d = chip_plane(chip, p);
+        if (!d)
+            continue;
+        if (chip->hires) {
+            for (int y = 0; y < DISPLAY_HI_H; y++) {
+                d[2*y] = (d[2*y] << 4) | (d[2*y + 1] >> 60);
+                d[2*y + 1] <<= 4;
+            }
+        }
+        else {
+            for (int y = 0; y < DISPLAY_H; y++)
+                d[y] <<= 4;
+        }
+    }
+    chip->dirty = CHIP_ALL_ROWS(chip);
+}
+
+// 5XY2/5XY3 register ranges run from vX to vY, backwards if X > Y
+static inline int chip_range(u8 x, u8 y, int k)
+{
+    return x <= y ? x + k : x - k;
+}
+
+// Handler indices into chip_run's dispatch table, 0 has to stay "not decoded yet" so a zeroed cache is valid
+enum {
+    OP_DECODE = 0, OP_NOP,
+    OP_00E0, OP_00EE, OP_1NNN, OP_2NNN, OP_3XNN, OP_4XNN, OP_5XY0, OP_6XNN, OP_7XNN,
+    OP_8XY0, OP_8XY1, OP_8XY2, OP_8XY3, OP_8XY4, OP_8XY5, OP_8XY6, OP_8XY7, OP_8XYE,
+    OP_9XY0, OP_ANNN, OP_BNNN, OP_CXNN, OP_DXYN, OP_EX9E, OP_EXA1,
+    OP_FX07, OP_FX0A, OP_FX15, OP_FX18, OP_FX1E, OP_FX29, OP_FX33, OP_FX55, OP_FX65,
+    // SUPER-CHIP and XO-CHIP, decoded the same under every profile but only executed as such by QUIRK_SUPER/QUIRK_XO
+    // interpreters
+    OP_00CN, OP_00FB, OP_00FC, OP_00FD, OP_00FE, OP_00FF, OP_FX30, OP_FX75, OP_FX85,
+    OP_00DN, OP_5XY2, OP_5XY3, OP_F000, OP_FN01, OP_F002, OP_FX3A,
+};
+
+// Bytes of a cache covering `entries` instructions, header included
+static size_t chip_cache_size(u32 entries)
+{
+    return sizeof(struct chip_cache) + entries * (sizeof(struct chip_block) + sizeof(struct chip_op));
+}
+
+static struct chip_cache *chip_cache_new(u32 entries)
+{
+    struct chip_cache *cache = calloc(1, chip_cache_size(entries));
+    if (!cache)
+        return NULL;
+    cache->refs = 1;
+    cache->blocks = (struct chip_block *)(cache + 1);
+    cache->ops = (struct chip_op *)(cache->blocks + entries);
+    cache->entries = entries;
+    return cache;
+}
+
+static struct chip_aot *aot_list; // Filled in by constructors before main, read-only after
+
+void chip_aot_register(struct chip_aot *aot)
+{
+    aot->next = aot_list;
+    aot_list = aot;
+}
+
+const struct chip_aot *chip_aot_find(const u8 *rom, size_t size, enum chip_quirks quirks)
+{
+    for (const struct chip_aot *aot = aot_list; aot; aot = aot->next)
+        if (aot->quirks == quirks && aot->rom_size == size && memcmp(aot->rom, rom, size) == 0)
+            return aot;
+    return NULL;
+}
+
+bool chip_aot_intact(const struct chip8 *chip, u16 addr, u16 len)
+{
+    for (u16 k = 0; k < len; k++)
+        if (CHIP_MEM(chip, (addr + k) & chip->mem_mask) != chip->aot->rom[addr + k - 0x200])
+            return false;
+    return true;
+}
+
+// Grow the written-over span by any translated bytes a write landed on
+static void chip_aot_written(struct chip8 *chip, u16 addr, u16 len)
+{
+    const struct chip_aot *aot = chip->aot;
+    for (u32 k = 0; k < len; k++) {
+        u16 a = (addr + k) & chip->mem_mask;
+        u32 b = a - 0x200u;
+        if (b >= aot->rom_size || !(aot->code[b >> 3] & (1 << (b & 7))))
+            continue;
+        if (chip->aot_lo == chip->aot_hi) {
+            chip->aot_lo = a;
+            chip->aot_hi = a + 1;
+        }
+        else if (a < chip->aot_lo)
+            chip->aot_lo = a;
+        else if (a >= chip->aot_hi)
+            chip->aot_hi = a + 1;
+    }
+}
+
+void chip_invalidate(struct chip8 *chip, u16 addr, u16 len)
+{
+    if (chip->aot)
+        chip_aot_written(chip, addr, len);
+    if (!chip->cache || len == 0)
+        return;
+
+    // A write to byte b only changes the instruction starting at b & ~1 (odd-aligned ones aren't cached)
+    u32 entries = chip->cache->entries;
+    u32 first = (addr & chip->mem_mask) >> 1;
+    u32 count = ((addr & 1) + len + 1) >> 1;
+    if (count > entries)
+        count = entries;
+    struct chip_op *ops = chip->cache->ops;
+    struct chip_block *blocks = chip->cache->blocks;
+    for (u32 k = 0; k < count; k++) {
+        int written = (first + k) & (entries - 1);
+
+        // Every op inside a live block is decoded, so writes to plain data can stop here
+        if (ops[written].handler == OP_DECODE)
+            continue;
+        ops[written].handler = OP_DECODE;
+
+        // Any block that starts up to CHIP_BLOCK_MAX-1 ops before the written op and reaches it is stale too
+        for (int start = written; start >= 0 && start > written - CHIP_BLOCK_MAX; start--)
+            if (start + blocks[start].len > written)
+                blocks[start].len = 0;
+    }
+}
+
+// Give a shared page to this machine alone before writing to it. A machine that has written to memory can't keep
+// sharing decoded code either, since translating from its memory would now hand the others the wrong ops
+static struct chip_page *chip_page_unshare(struct chip8 *chip, u16 addr)
+{
+    // Nowhere to report failure from the middle of an instruction, and carrying on would corrupt the other forks
+    struct chip_page **slot = &chip->pages[addr >> CHIP_PAGE_SHIFT];
+    struct chip_page *page = malloc(sizeof(*page));
+    if (!page) {
+        fprintf(stderr, "Out of memory copying a shared page\n");
+        abort();
+    }
+    memcpy(page->data, (*slot)->data, CHIP_PAGE_SIZE);
+    page->refs = 1;
+    (*slot)->refs--;
+    *slot = page;
+
+    if (chip->cache && chip->cache->refs > 1) {
+        size_t size = chip_cache_size(chip->cache->entries);
+        struct chip_cache *cache = malloc(size);
+        if (!cache) {
+            fprintf(stderr, "Out of memory copying a shared cache\n");
+            abort();
+        }
+        memcpy(cache, chip->cache, size);
+        cache->blocks = (struct chip_block *)(cache + 1);
+        cache->ops = (struct chip_op *)(cache->blocks + cache->entries);
+        cache->refs = 1;
+        chip_cache_release(chip);
+        chip->cache = cache;
+    }
+    return page;
+}
+
+// Store one byte, `addr` already masked. The caller invalidates
+static inline void chip_poke(struct chip8 *chip, u16 addr, u8 value)
+{
+    struct chip_page *page = chip->pages[addr >> CHIP_PAGE_SHIFT];
+    if (page->refs > 1)
+        page = chip_page_unshare(chip, addr);
+    page->data[addr & (CHIP_PAGE_SIZE - 1)] = value;
+}
+
+// FX55/FX65 from the interpreters: a few bytes at a time, nearly always inside one page, and too short for memcpy to
+// pay off. The caller invalidates
+static inline void chip_store_range(struct chip8 *chip, u16 addr, u16 mask, const u8 *data, u32 len)
+{
+    u16 at = addr & mask;
+    struct chip_page *page = chip->pages[at >> CHIP_PAGE_SHIFT];
+    u32 offset = at & (CHIP_PAGE_SIZE - 1);
+    if (offset + len <= CHIP_PAGE_SIZE && page->refs <= 1) {
+        for (u32 k = 0; k < len; k++)
+            page->data[offset + k] = data[k];
+        return;
+    }
+    for (u32 k = 0; k < len; k++)
+        chip_poke(chip, (addr + k) & mask, data[k]);
+}
+
+static inline void chip_load_range(const struct chip8 *chip, u16 addr, u16 mask, u8 *out, u32 len)
+{
+    u16 at = addr & mask;
+    const u8 *src = &CHIP_MEM(chip, at);
+    if ((at & (CHIP_PAGE_SIZE - 1)) + len <= CHIP_PAGE_SIZE) {
+        for (u32 k = 0; k < len; k++)
+            out[k] = src[k];
+        return;
+    }
+    for (u32 k = 0; k < len; k++)
+        out[k] = CHIP_MEM(chip, (addr + k) & mask);
+}
+
+// Both copy a page at a time. Memory is a whole number of pages, so wrapping at the end is just masking the address
+void chip_mem_read(const struct chip8 *chip, u16 addr, u8 *out, size_t len)
+{
+    u16 at = addr & chip->mem_mask;
+    while (len) {
+        size_t chunk = CHIP_PAGE_SIZE - (at & (CHIP_PAGE_SIZE - 1));
+        if (chunk > len)
+            chunk = len;
+        memcpy(out, &CHIP_MEM(chip, at), chunk);
+        out += chunk;
+        len -= chunk;
+        at = (at + chunk) & chip->mem_mask;
+    }
+}
+
+void chip_mem_write(struct chip8 *chip, u16 addr, const u8 *data, size_t len)
+{
+    u16 at = addr & chip->mem_mask;
+    for (size_t left = len; left; ) {
+        size_t chunk = CHIP_PAGE_SIZE - (at & (CHIP_PAGE_SIZE - 1));
+        if (chunk > left)
+            chunk = left;
+        struct chip_page *page = chip->pages[at >> CHIP_PAGE_SHIFT];
+        if (page->refs > 1)
+            page = chip_page_unshare(chip, at);
+        memcpy(&page->data[at & (CHIP_PAGE_SIZE - 1)], data, chunk);
+        data += chunk;
+        left -= chunk;
+        at = (at + chunk) & chip->mem_mask;
+    }
+    chip_invalidate(chip, addr, len > chip->mem_mask ? chip->mem_mask : len);
+}
+
+bool chip_fork(struct chip8 *parent, struct chip8 *child)
+{
+    // Pages built into the parent die with it, so the first fork moves them out to the heap where they can be shared
+    u32 count = (parent->mem_mask + 1u) >> CHIP_PAGE_SHIFT;
+    for (u32 k = 0; k < count; k++) {
+        if (parent->pages[k]->refs)
+            continue;
+        struct chip_page *page = malloc(sizeof(*page));
+        if (!page)
+            return false;
+        memcpy(page->data, parent->pages[k]->data, CHIP_PAGE_SIZE);
+        page->refs = 1;
+        parent->pages[k] = page;
+    }
+    free(parent->pages_big);
+    parent->pages_big = NULL;
+
+    memcpy(child, parent, offsetof(struct chip8, pages));
+    for (u32 k = 0; k < count; k++) {
+        child->pages[k] = parent->pages[k];
+        child->pages[k]->refs++;
+    }
+    child->pages_big = NULL;
+    if (child->cache)
+        child->cache->refs++;
+    child->trace = NULL;
+#ifdef CHIP_PROFILER
+    child->profile = NULL;
+#endif
+    return true;
+}
+
+double chip_footprint(const struct chip8 *chip)
+{
+    double bytes = 0;
+    for (u32 k = 0; k < (chip->mem_mask + 1u) >> CHIP_PAGE_SHIFT; k++)
+        if (chip->pages[k]->refs)
+            bytes += (double)sizeof(struct chip_page) / chip->pages[k]->refs;
+    if (chip->pages_big)
+        bytes += CHIP_PAGES_MAX * sizeof(struct chip_page);
+    if (chip->cache)
+        bytes += (double)chip_cache_size(chip->cache->entries) / chip->cache->refs;
+    return bytes;
+}
+
+// Mirrors the decode in chip_cycle, including treating 5XYN/9XYN as 5XY0/9XY0 and unknown instructions as no-ops.
+// SUPER-CHIP/XO-CHIP ops get their own handlers whatever the profile, the other interpreters run them as they always
+// did: no-ops, or 5XY0 for 5XY2/5XY3
+static u8 chip_decode_handler(u16 instruction)
+{
+    u16 nn = instruction & 0xFF;
+    switch (instruction >> 12) {
+        case 0x0:
+            if (instruction == 0x00E0) return OP_00E0;
+            if (instruction == 0x00EE) return OP_00EE;
+            if (instruction == 0x00FB) return OP_00FB;
+            if (instruction == 0x00FC) return OP_00FC;
+            if (instruction == 0x00FD) return OP_00FD;
+            if (instruction == 0x00FE) return OP_00FE;
+            if (instruction == 0x00FF) return OP_00FF;
+            if ((instruction & 0xFFF0) == 0x00C0) return OP_00CN;
+            if ((instruction & 0xFFF0) == 0x00D0) return OP_00DN;
+            return OP_NOP;
+        case 0x1: return OP_1NNN;
+        case 0x2: return OP_2NNN;
+        case 0x3: return OP_3XNN;
+        case 0x4: return OP_4XNN;
         case 0x5:
-            // 5XY0: Skip next if vX == vY
-            if (v[x] == v[y])
-                chip->pc += 2;
-            break;
-        case 0x6:
-            // 6XNN: Set vX = NN
-            v[x] = nn;
-            break;
-        case 0x7:
-            // 7XNN: Add NN to vX, without carry
-            v[x] += nn;
-            break;
+            if ((instruction & 0xF) == 0x2) return OP_5XY2;
+            if ((instruction & 0xF) == 0x3) return OP_5XY3;
+            return OP_5XY0;
+        case 0x6: return OP_6XNN;
+        case 0x7: return OP_7XNN;
         case 0x8:
-            // Arithmetic instructions, n conveniently also denotes which one!
-            switch (n) {
-                case 0x0:
-                    // 8XY0: Set vX = vY
-                    v[x] = v[y];
-                    break;
-                case 0x1:
-                    // 8XY1: OR, vX |= vY
-                    v[x] |= v[y];
-                    break;
-                case 0x2:
-                    // 8XY2: AND, vX &= vY
-                    v[x] &= v[y];
-                    break;
-                case 0x3:
-                    // 8XY3: XOR, vX ^= vY
-                    v[x] ^= v[y];
-                    break;
-                case 0x4:
-                    // 8XY4: Add, vX += vY
-                    v[x] += v[y];
-                    v[0xF] = (v[x] < v[y]); // Overflow detection!
-                    break;
-                case 0x5:
-                    // 8XY5: Subtract, vX -= vY
-                    u8 flag5 = (v[x] >= v[y]) ? 1 : 0;
-                    v[x] -= v[y];
-                    v[0xF] = flag5;
-                    break;
-                case 0x6:
-                    // 8XY6: Shift, vX = vY >> 1, setting vF to the shifted out bit
-                    // AMBIGUOUS!!! This is correct on CHIP8 but not on SUPER-CHIP
-                    v[x] = v[y];
-                    u8 carry6 = (v[x] & 0x1);
-                    v[x] >>= 1;
-                    v[0xF] = carry6;
-                    break;
-                case 0x7:
-                    // 8XY7: Subtract, vX = vY - vX
-                    u8 flag8 = (v[y] >= v[x]) ? 1 : 0;
-                    v[x] = v[y] - v[x];
-                    v[0xF] = flag8;
-                    break;
-                case 0xE:
-                    // 8XYE: Shift, vX = vY << 1, setting vF to the shifted out bit
-                    // AMBIGUOUS!!! This is correct on CHIP8 but not on SUPER-CHIP
-                    v[x] = v[y];
-                    u8 carryE = (v[x] & 0x80) >> 7;
-                    v[x] <<= 1;
-                    v[0xF] = carryE;
-                    break;
+            switch (instruction & 0xF) {
+                case 0x0: return OP_8XY0;
+                case 0x1: return OP_8XY1;
+                case 0x2: return OP_8XY2;
+                case 0x3: return OP_8XY3;
+                case 0x4: return OP_8XY4;
+                case 0x5: return OP_8XY5;
+                case 0x6: return OP_8XY6;
+                case 0x7: return OP_8XY7;
+                case 0xE: return OP_8XYE;
             }
-            break;
-        case 0x9:
-            // 9XY0: Skip next if vX != vY
-            if (v[x] != v[y])
-                chip->pc += 2;
-            break;
-        case 0xA:
-            // ANNN: Set index
-            chip->i = nnn;
-            break;
-        case 0xB:
-            // BNNN: Jump with offset
-            // AMBIGUOUS!!! Correct on CHIP8 but not on SUPERCHIP
-            chip->pc = (nnn + v[0]) & 0xFFF;
-            break;
-        case 0xC:
-            // CXNN: Random
-            v[x] = rand() & nn;
-            break;
-        case 0xD:
-            // DXYN: Display
-            u8 sx = v[x] % DISPLAY_W,
-               sy = v[y] % DISPLAY_H;
-            v[0xF] = 0;
-            if (chip->debug) printf("Drawing %d lines, starting at (%d,%d), where I=%d\n", (int)n, (int)sx, (int)sy, (int)chip->i);
-
-            for (int r = 0; r < n; r++) {
-                if (sy+r >= DISPLAY_H)
-                    break;
-                
-                u8 row = chip->mem[(chip->i + r) & 0xFFF];
-                u8 py = (sy+r) % DISPLAY_H;
-                
-                for (int c = 0; c < 8; c++) {
-                    u8 px = (sx+c) % DISPLAY_W;
-
-                    u8 cur_pixel = DISPLAY_GET(chip->display, px, py);
-                    u8 new_pixel = (row & (0x80 >> c)) ? 1 : 0;
-                    if (cur_pixel && new_pixel)
-                        v[0xF] = 1;
-                    
-                    DISPLAY_WRITE(chip->display, px, py, new_pixel ^ cur_pixel);
-                }
-            }
-
-            redraw = true;
-            break;
+            return OP_NOP;
+        case 0x9: return OP_9XY0;
+        case 0xA: return OP_ANNN;
+        case 0xB: return OP_BNNN;
+        case 0xC: return OP_CXNN;
+        case 0xD: return OP_DXYN;
         case 0xE:
-            // EXnn: Skip if key instructions, nn is already conveniently decoded!
-            switch (nn) {
-                case 0x9E:
-                    // EX9E: Skip if key in vX is pressed
-                    if ((key_mask & (1 << v[x])) > 0)
-                        chip->pc += 2;
-                    break;
-                case 0xA1:
-                    // EXA1: Skip if key in vX is NOT pressed
-                    if ((key_mask & (1 << v[x])) == 0)
-                        chip->pc += 2;
-                    break;
-            }
-            break;
+            if (nn == 0x9E) return OP_EX9E;
+            if (nn == 0xA1) return OP_EXA1;
+            return OP_NOP;
         case 0xF:
-            // FXnn: Timers, index add, get key, font char, BCD convert and mem store/loads
             switch (nn) {
-                // Timers
-                case 0x07:
-                    // FX07: Set vX = current value of delay timer
-                    v[x] = chip->delay;
-                    break;
-                case 0x15:
-                    // FX15: Set delay timer = vX
-                    chip->delay = v[x];
-                    break;
-                case 0x18:
-                    // FX18: Set sound timer = vX
-                    chip->sound = v[x];
-                    break;
-                
-                case 0x1E:
-                    // FX1E: Add to index
-                    // AMBIGUOUS: Just doing it the way the Amiga one did it
-                    chip->i += v[x];
-                    v[0xF] = (chip->i > 0x0FFF);
-                    chip->i &= 0x0FFF;
-                    break;
-                
-                case 0x0A:
-                    // FX0A: Get key
-                    if (key_mask == 0) {
-                        chip->pc -= 2;
-                    }
-                    else {
-                        // Find the pressed key
-                        for (int i = 0; i < 16; i++) {
-                            if (key_mask & (1 << i)) {
-                                v[x] = i;
-                                break;
-                            }
-                        }
-                    }
-                    break;
-                
-                case 0x29:
-                    // FX29: Font character, i = &hex_char[X]
-                    chip->i = font_addr + v[x]*5;
-                    break;
-                
-                case 0x33:
-                    // FX33: BCD convert
-                    chip->mem[chip->i  ] =  v[x] / 100;
-                    chip->mem[chip->i+1] = (v[x] / 10) % 10;
-                    chip->mem[chip->i+2] =  v[x] % 10;
-                    break;
-                
-                case 0x55:
-                    // FX55: Store registers from v0-vX into mem starting from i
-                    // MODERN: Does not increment i, so not compatible with original CHIP8
-                    for (int i = 0; i <= x; i++)
-                        chip->mem[chip->i + i] = v[i];
-                    break;
-                case 0x65:
-                    // FX65: Load registers to v0-vX from mem starting from i
-                    // MODERN: Does not increment i, so not compatible with original CHIP8
-                    for (int i = 0; i <= x; i++)
-                        v[i] = chip->mem[chip->i + i];
-                    break;
+                case 0x07: return OP_FX07;
+                case 0x0A: return OP_FX0A;
+                case 0x15: return OP_FX15;
+                case 0x18: return OP_FX18;
+                case 0x1E: return OP_FX1E;
+                case 0x29: return OP_FX29;
+                case 0x33: return OP_FX33;
+                case 0x55: return OP_FX55;
+                case 0x65: return OP_FX65;
+                case 0x30: return OP_FX30;
+                case 0x75: return OP_FX75;
+                case 0x85: return OP_FX85;
+                case 0x3A: return OP_FX3A;
+                case 0x01: return OP_FN01;
+                case 0x00: return instruction == 0xF000 ? OP_F000 : OP_NOP;
+                case 0x02: return instruction == 0xF002 ? OP_F002 : OP_NOP;
             }
+            return OP_NOP;
     }
+    return OP_NOP;
+}
 
-    // Timer logic
-    chip->timer += deltatime;
-    if (chip->timer >= 1000) {
-        chip->timer -= 1000;
-        if (chip->delay != 0) chip->delay--;
-        if (chip->sound != 0) chip->sound--;
+static void chip_decode(struct chip8 *chip, u16 addr, struct chip_op *op)
+{
+    u16 instruction = (CHIP_MEM(chip, addr) << 8) | CHIP_MEM(chip, (addr + 1) & chip->mem_mask);
+    op->x = (instruction >> 8) & 0x0F;
+    op->y = (instruction >> 4) & 0x0F;
+    op->n = instruction & 0x000F;
+    op->nnn = instruction & 0x0FFF;
+    op->handler = chip_decode_handler(instruction);
+}
+
+// Ops after which execution can't just carry on with the next address, or which might overwrite the block itself.
+// Skips don't end a block, a taken one leaves it early (see BLOCK_SKIP in chip_run)
+static bool chip_ends_block(u8 handler)
+{
+    switch (handler) {
+        case OP_00EE: case OP_1NNN: case OP_2NNN: case OP_BNNN:
+        case OP_FX0A: case OP_FX33: case OP_FX55: case OP_00FD:
+        case OP_5XY2: case OP_5XY3: case OP_F000: // 5XY2/5XY3 are skips outside XO-CHIP, F000 eats the next word
+            return true;
+    }
+    return false;
+}
+
+// Whether the block at `addr` starts one of the idle loops chip_idle_skip knows how to jump over
+static u8 chip_idle_kind(struct chip8 *chip, u16 addr, u16 len)
+{
+    struct chip_op *op = &chip->cache->ops[addr >> 1];
+    if (op[0].handler == OP_FX0A)
+        return CHIP_IDLE_KEY;
+
+    // FX07 vX; 3X00; a jump straight back to the FX07, all as a block of its own
+    if (len != 3 || op[0].handler != OP_FX07 || op[1].handler != OP_3XNN || op[1].x != op[0].x ||
+        op[1].nnn & 0xFF || op[2].handler != OP_1NNN || op[2].nnn != addr)
+        return CHIP_IDLE_NONE;
+    return CHIP_IDLE_DELAY;
+}
+
+// Jump over as much of the idle loop at pc as can be done without changing what the program sees, leaving the machine
+// exactly where running the same number of cycles would have. Returns the cycles used, 0 to just run it normally
+static u32 chip_idle_skip(struct chip8 *chip, u8 kind, u16 pc, u16 key_mask, u16 deltatime, u32 cycles)
+{
+    u32 unit = (u32)deltatime * 60; // Timer units each cycle adds
+
+    // Keys don't change within a chip_run, so FX0A waits out the whole budget with pc parked on it
+    if (kind == CHIP_IDLE_KEY) {
+        if (key_mask)
+            return 0;
+        chip_advance_units(chip, (u64)cycles * unit);
+        return cycles;
     }
 
+    // Whole 3-op iterations where the FX07 still reads a running timer. Iteration k's FX07 runs after 3k cycles worth
+    // of time, so the last skipped one must still see delay > 0
+    if (chip->delay == 0)
+        return 0;
+    u64 iterations = cycles / 3;
+    if (unit) {
+        u64 before_zero = ((u64)chip->delay * 1000 - chip->timer - 1) / unit; // Cycles until it would read 0
+        if (iterations > before_zero / 3 + 1)
+            iterations = before_zero / 3 + 1;
+    }
+    if (iterations == 0)
+        return 0;
+
+    chip_advance_units(chip, (iterations - 1) * 3 * unit);
+    chip->v[chip->cache->ops[pc >> 1].x] = chip->delay;
+    chip_advance_units(chip, 3 * unit);
+    chip->pc = pc;
+    return (u32)iterations * 3;
+}
+
+// Decode the straight-line run starting at the even address `addr` and record its length. Blocks never wrap past the
+// end of memory
+static u16 chip_translate(struct chip8 *chip, u16 addr)
+{
+    struct chip_op *ops = chip->cache->ops;
+    u16 len = 0;
+    while (len < CHIP_BLOCK_MAX && addr + len*2 <= chip->mem_mask - 1) {
+        struct chip_op *op = &ops[(addr >> 1) + len];
+        if (op->handler == OP_DECODE)
+            chip_decode(chip, addr + len*2, op);
+        len++;
+        if (chip_ends_block(op->handler))
+            break;
+    }
+    chip->cache->blocks[addr >> 1].len = len;
+    chip->cache->blocks[addr >> 1].idle = chip_idle_kind(chip, addr, len);
+    return len;
+}
+
+// One specialised interpreter pair per quirk profile
+#define CORE(name) chip_##name##_default
+#define QUIRK_SHIFT_VX       0
+#define QUIRK_JUMP_VX        0
+#define QUIRK_LOAD_STORE_INC 0
+#define QUIRK_ADDI_CARRY     1
+#define QUIRK_CLIP           0
+#define QUIRK_LOGIC_VF       0
+#define QUIRK_SUPER          0
+#define QUIRK_XO             0
+#include "chip8_core.h"
+#undef CORE
+#undef QUIRK_SHIFT_VX
+#undef QUIRK_JUMP_VX
+#undef QUIRK_LOAD_STORE_INC
+#undef QUIRK_ADDI_CARRY
+#undef QUIRK_CLIP
+#undef QUIRK_LOGIC_VF
+#undef QUIRK_SUPER
+#undef QUIRK_XO
+
+#define CORE(name) chip_##name##_chip8
+#define QUIRK_SHIFT_VX       0
+#define QUIRK_JUMP_VX        0
+#define QUIRK_LOAD_STORE_INC 1
+#define QUIRK_ADDI_CARRY     0
+#define QUIRK_CLIP           1
+#define QUIRK_LOGIC_VF       1
+#define QUIRK_SUPER          0
+#define QUIRK_XO             0
+#include "chip8_core.h"
+#undef CORE
+#undef QUIRK_SHIFT_VX
+#undef QUIRK_JUMP_VX
+#undef QUIRK_LOAD_STORE_INC
+#undef QUIRK_ADDI_CARRY
+#undef QUIRK_CLIP
+#undef QUIRK_LOGIC_VF
+#undef QUIRK_SUPER
+#undef QUIRK_XO
+
+#define CORE(name) chip_##name##_schip
+#define QUIRK_SHIFT_VX       1
+#define QUIRK_JUMP_VX        1
+#define QUIRK_LOAD_STORE_INC 0
+#define QUIRK_ADDI_CARRY     0
+#define QUIRK_CLIP           1
+#define QUIRK_LOGIC_VF       0
+#define QUIRK_SUPER          1
+#define QUIRK_XO             0
+#include "chip8_core.h"
+#undef CORE
+#undef QUIRK_SHIFT_VX
+#undef QUIRK_JUMP_VX
+#undef QUIRK_LOAD_STORE_INC
+#undef QUIRK_ADDI_CARRY
+#undef QUIRK_CLIP
+#undef QUIRK_LOGIC_VF
+#undef QUIRK_SUPER
+#undef QUIRK_XO
+
+#define CORE(name) chip_##name##_xo
+#define QUIRK_SHIFT_VX       0
+#define QUIRK_JUMP_VX        0
+#define QUIRK_LOAD_STORE_INC 1
+#define QUIRK_ADDI_CARRY     0
+#define QUIRK_CLIP           0
+#define QUIRK_LOGIC_VF       0
+#define QUIRK_SUPER          1
+#define QUIRK_XO             1
+#include "chip8_core.h"
+#undef CORE
+#undef QUIRK_SHIFT_VX
+#undef QUIRK_JUMP_VX
+#undef QUIRK_LOAD_STORE_INC
+#undef QUIRK_ADDI_CARRY
+#undef QUIRK_CLIP
+#undef QUIRK_LOGIC_VF
+#undef QUIRK_SUPER
+#undef QUIRK_XO
+
+static bool (*const cycle_fns[QUIRKS_COUNT])(struct chip8 *, u16, u16) = {
+    [QUIRKS_DEFAULT] = chip_cycle_default,
+    [QUIRKS_CHIP8]   = chip_cycle_chip8,
+    [QUIRKS_SCHIP]   = chip_cycle_schip,
+    [QUIRKS_XO]      = chip_cycle_xo,
+};
+
+static bool (*const run_fns[QUIRKS_COUNT])(struct chip8 *, u16, u16, u32) = {
+    [QUIRKS_DEFAULT] = chip_run_default,
+    [QUIRKS_CHIP8]   = chip_run_chip8,
+    [QUIRKS_SCHIP]   = chip_run_schip,
+    [QUIRKS_XO]      = chip_run_xo,
+};
+
+// chip_cycle with a trace attached: run the instruction, then log what it did
+static bool chip_cycle_traced(struct chip8 *chip, u16 key_mask, u16 deltatime)
+{
+    struct trace_record r = {
+        .cycle = chip->trace->cycle++,
+        .pc = chip->pc & chip->mem_mask,
+        .instruction = (CHIP_MEM(chip, chip->pc & chip->mem_mask) << 8) | CHIP_MEM(chip, (chip->pc + 1) & chip->mem_mask),
+        .reg = 0xFF,
+    };
+    u8 before[16];
+    memcpy(before, chip->v, sizeof(before));
+
+    bool redraw = cycle_fns[chip->quirks](chip, key_mask, deltatime);
+
+    u8 x = (r.instruction >> 8) & 0x0F;
+    if (chip->v[x] != before[x]) {
+        r.reg = x;
+    }
+    else {
+        for (int k = 0; k < 16; k++) {
+            if (chip->v[k] != before[k]) {
+                r.reg = k;
+                break;
+            }
+        }
+    }
+    if (r.reg != 0xFF)
+        r.value = chip->v[r.reg];
+    r.i = chip->i;
+    trace_push(chip->trace, &r);
     return redraw;
 }
+
+bool chip_cycle(struct chip8 *chip, u16 key_mask, u16 deltatime)
+{
+    if (chip->trace)
+        return chip_cycle_traced(chip, key_mask, deltatime);
+    return cycle_fns[chip->quirks](chip, key_mask, deltatime);
+}
+
+bool chip_run(struct chip8 *chip, u16 key_mask, u16 deltatime, u32 cycles)
+{
+    bool redraw = false;
+    chip->idle = CHIP_IDLE_NONE;
+    chip->insns += cycles;
+
+    // The reference interpreter is also the only one that knows how to trace or feed the profiler
+    bool reference = chip->reference || chip->trace;
+#ifdef CHIP_PROFILER
+    reference |= chip->profile != NULL;
+#endif
+    if (reference) {
+        bool (*cycle)(struct chip8 *, u16, u16) = chip->trace ? chip_cycle_traced : cycle_fns[chip->quirks];
+        while (cycles--)
+            redraw |= cycle(chip, key_mask, deltatime);
+        return redraw;
+    }
+
+    if (chip->aot && chip->aot->quirks == chip->quirks) {
+        redraw = chip->aot->run(chip, key_mask, deltatime, cycles);
+
+        // Translated code runs FX0A rather than skipping it, but a frontend still wants to know it can sleep
+        u16 pc = chip->pc & chip->mem_mask;
+        if (!key_mask && (CHIP_MEM(chip, pc) & 0xF0) == 0xF0 && CHIP_MEM(chip, (pc + 1) & chip->mem_mask) == 0x0A)
+            chip->idle = CHIP_IDLE_KEY;
+        return redraw;
+    }
+
+    if (!chip->cache) {
+        chip->cache = chip_cache_new((chip->mem_mask + 1) / 2);
+        if (!chip->cache) {
+            chip->reference = true;
+            chip->insns -= cycles; // The retry counts them
+            return chip_run(chip, key_mask, deltatime, cycles);
+        }
+    }
+
+    return run_fns[chip->quirks](chip, key_mask, deltatime, cycles);
+}
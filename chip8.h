@@ -1,9 +1,11 @@
 #pragma once
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 typedef uint8_t u8;
 typedef uint16_t u16;
+typedef uint32_t u32;
 typedef uint64_t u64;
 
 #define DISPLAY_W 64
@@ -12,36 +14,228 @@ typedef uint64_t u64;
 #define DISPLAY_SET(d,x,y) ((d)[y] |=  (1ULL << (63-x)))
 #define DISPLAY_CLR(d,x,y) ((d)[y] &= ~(1ULL << (63-x)))
 #define DISPLAY_WRITE(d,x,y,p) ((p) ? DISPLAY_SET(d,x,y) : DISPLAY_CLR(d,x,y))
+#define DISPLAY_ALL_ROWS ((u64)-1 >> (64 - DISPLAY_H))
+
+// SUPER-CHIP hi-res mode: 128x64, each row is two longs (left half, right half), so row y is d[2y] and d[2y+1]
+#define DISPLAY_HI_W 128
+#define DISPLAY_HI_H 64
+#define DISPLAY_HI_GET(d,x,y) (((d)[2*(y) + ((x) >> 6)] >> (63 - ((x) & 63))) & 0x1)
+#define DISPLAY_HI_ALL_ROWS ((u64)-1)
+
+// Whichever resolution the chip is in right now. CHIP_GET is a pixel's colour, 0-3 (bit 1 is the XO-CHIP second plane)
+#define CHIP_W(c) ((c)->hires ? DISPLAY_HI_W : DISPLAY_W)
+#define CHIP_H(c) ((c)->hires ? DISPLAY_HI_H : DISPLAY_H)
+#define CHIP_GET(c,x,y) ((c)->hires \
+    ? (DISPLAY_HI_GET((c)->display,x,y) | DISPLAY_HI_GET((c)->display2,x,y) << 1) \
+    : (DISPLAY_GET((c)->display,x,y) | DISPLAY_GET((c)->display2,x,y) << 1))
+#define CHIP_ALL_ROWS(c) ((c)->hires ? DISPLAY_HI_ALL_ROWS : DISPLAY_ALL_ROWS)
+
+// Memory is a table of small pages so forked machines can share everything neither side has written to (see
+// chip_fork). Read a byte with CHIP_MEM, `addr` already masked with mem_mask. Write with chip_mem_write
+#define CHIP_PAGE_SHIFT 8
+#define CHIP_PAGE_SIZE  (1 << CHIP_PAGE_SHIFT)
+#define CHIP_PAGES_MAX  (0x10000 >> CHIP_PAGE_SHIFT)
+#define CHIP_MEM(c, addr) ((c)->pages[(addr) >> CHIP_PAGE_SHIFT]->data[(addr) & (CHIP_PAGE_SIZE - 1)])
+
+struct chip_page {
+    u32 refs; // Machines using this page, 0 for one built into a machine that has never been forked
+    u8 data[CHIP_PAGE_SIZE];
+};
+
+// One pre-decoded instruction, see chip_run
+struct chip_op {
+    u8 handler; // Index into chip_run's dispatch table, 0 means "not decoded yet"
+    u8 x, y, n;
+    u16 nnn;    // nn is just the low byte of this
+};
+
+// A straight-line run of decoded ops, ending in a jump, call, return or memory write. Skips can sit anywhere in one
+#define CHIP_BLOCK_MAX 32
+
+// Loops chip_run recognises as "waiting", and skips through without running them op by op
+enum chip_idle {
+    CHIP_IDLE_NONE,
+    CHIP_IDLE_DELAY, // FX07 vX / 3X00 / 1NNN back to the FX07: spinning until the delay timer runs out
+    CHIP_IDLE_KEY,   // FX0A with nothing pressed, it rewinds pc and runs again every cycle
+};
+
+struct chip_block {
+    u16 len;  // Number of ops, 0 means "not translated yet"
+    u8 idle;  // enum chip_idle, when the block is the start of a recognised idle loop
+};
+
+// Decoded form of mem, one entry per even address. Odd addresses are rare enough to just go through chip_cycle.
+// Sized to the memory it covers (2048 entries, or 32768 for XO-CHIP), both arrays live in the same allocation
+struct chip_cache {
+    struct chip_op *ops;
+    struct chip_block *blocks; // Indexed by the start address / 2, same as ops
+    u32 entries;
+    u32 refs; // Forks share their parent's cache until either side writes to memory
+
+    u64 block_insns; // Instructions run as part of a whole block
+    u64 step_insns;  // Instructions that had to be run one at a time
+    u64 idle_insns;  // Instructions skipped over inside idle loops, counted in the budget but never run
+};
+
+struct chip_profile;
+struct chip_trace;
+
+// Behaviour differences between interpreters that real programs depend on. Each profile gets its own compiled copy of
+// the interpreter (see chip8_core.h), so switching profiles costs nothing per instruction
+enum chip_quirks {
+    QUIRKS_DEFAULT, // What this emulator always did: shifts read vY, B jumps off v0, FX1E sets vF, sprites wrap
+    QUIRKS_CHIP8,   // COSMAC VIP: FX55/FX65 advance i, 8XY1-3 reset vF, sprites clip at the edge
+    QUIRKS_SCHIP,   // SUPER-CHIP 1.1: shifts work on vX, BXNN jumps off vX, sprites clip at the edge, plus hi-res,
+                    // scrolling, 16x16 sprites, the big font and RPL flags. The only profile with 00FD/00FE/00FF etc
+    QUIRKS_XO,      // XO-CHIP: SUPER-CHIP's instructions plus 64KB of memory, two bitplanes, F000 NNNN, 5XY2/5XY3,
+                    // 00DN and the audio pattern buffer. FX55/FX65 advance i and sprites wrap, like Octo
+    QUIRKS_COUNT,
+};
+
+// What the loading functions return instead of giving up on the whole process
+enum chip_error {
+    CHIP_OK,
+    CHIP_ERR_IO,      // Couldn't open, map or read the file, errno says why
+    CHIP_ERR_TOO_BIG, // Doesn't fit between 0x200 and the end of the machine's memory
+    CHIP_ERR_NOMEM,
+};
+
+// A ROM image many machines can load from. Opened from a file it's a read-only mapping, so thousands of instances
+// share one copy in the page cache and loading one is a memcpy rather than an open and a read
+struct chip_rom {
+    const u8 *data;
+    size_t size;
+    bool mapped; // data is ours to munmap, otherwise it belongs to whoever called chip_rom_wrap
+};
 
 extern const u16 font_addr;
 extern const u8 font[];
+extern const u16 font_big_addr; // SUPER-CHIP 8x10 digits for FX30, right after the small font
+extern const u8 font_big[];
 
+// Holds pointers into itself (pages), so copy machines with chip_fork or chip_save/chip_restore rather than by value
 struct chip8 {
-    u8 mem[0x1000];
-    
+    u16 mem_mask; // 0xFFF, or 0xFFFF in XO-CHIP mode
+
     u16 pc;
     u16 i;
     
     u16 stack[48];
     u8 sp;
 
-    u64 display[((DISPLAY_W / 8) / sizeof(u64)) * DISPLAY_H]; // Using a long for each row, so the display is 32 longs (64-bit)
+    // Using a long for each row, so the lo-res display is the first 32 longs (64-bit). Hi-res uses all of it, see
+    // DISPLAY_HI_GET. Switching modes clears the whole thing
+    u64 display[((DISPLAY_HI_W / 8) / sizeof(u64)) * DISPLAY_HI_H];
+    u64 display2[((DISPLAY_HI_W / 8) / sizeof(u64)) * DISPLAY_HI_H]; // XO-CHIP's second bitplane, same layout
+    u8 planes; // Bitplanes DXYN, 00E0 and the scrolls work on (FN01): bit 0 is display, bit 1 display2
+    u64 dirty; // Bit y is set when display row y changed, the frontend clears the bits it has drawn
+    bool hires; // SUPER-CHIP 128x64 mode, set by 00FF and cleared by 00FE
+    bool halted; // Set by 00FD, the program asked to exit and pc stays parked on the 00FD
 
     u8 delay;
     u8 sound;
-    u16 timer;
+    u32 timer; // Emulated time since the last 60Hz timer tick, in 1/60ths of a ms so deltatime maps onto it exactly
+    u8 pattern[16]; // XO-CHIP audio: 128 1-bit samples played while the sound timer runs (F002)
+    u8 pitch;       // Pattern playback rate, 4000*2^((pitch-64)/48) samples/sec (FX3A)
+    bool pattern_loaded; // F002 has run. Until then XO-CHIP programs get the plain buzzer like everything else
 
     u8 v[16];
+    u8 rpl[16]; // SUPER-CHIP "RPL user flags", FX75/FX85 save/restore registers here
+
+    u32 rng; // Per-instance xorshift state for CXNN, so instances don't share rand()
 
-    bool debug;
+    bool reference; // Makes chip_run fall back to plain chip_cycle calls
+    enum chip_quirks quirks; // QUIRKS_DEFAULT unless changed with chip_set_quirks
+    enum chip_idle idle; // Set when the last chip_run ended inside an idle loop, so a frontend knows it can sleep
+    u64 insns; // Instructions chip_run has been asked for since chip_init, idle ones included. For telemetry
+    u64 draws; // DXYNs run since chip_init
+
+    struct chip_cache *cache; // Allocated by the first chip_run, NULL until then
+    struct chip_trace *trace; // Every instruction gets logged here when set, see trace.h
+    const struct chip_aot *aot; // Translated code for the loaded ROM, when one was linked in. See aot.h
+    u32 aot_lo, aot_hi;         // Translated code in [aot_lo, aot_hi) has been written over, blocks there check their bytes
+#ifdef CHIP_PROFILER
+    struct chip_profile *profile; // See profile.h
+#endif
+
+    // Memory last, chip_fork copies everything above as is and shares these. The first (mem_mask + 1) / CHIP_PAGE_SIZE
+    // pages are in use
+    struct chip_page *pages[CHIP_PAGES_MAX];
+    struct chip_page *pages_big; // XO-CHIP's 64KB as one block, until a fork moves the pages out of it
+    struct chip_page pages_small[0x1000 / CHIP_PAGE_SIZE]; // Classic machines never allocate memory, and keep it
+                                                           // inline like they always did
 };
 
 // Initialize a CHIP-8 struct
 void chip_init(struct chip8 *chip);
 
-// Load a program into the CHIP-8 given a path to the file
-void chip_load(struct chip8 *chip, const char *program);
+// Allocate and initialize a machine with the given profile and CXNN seed. Only touches its own memory, so instances
+// can be made from any thread. Returns NULL if out of memory
+struct chip8 *chip_new(enum chip_quirks quirks, u32 seed);
+
+// chip_deinit and free a machine from chip_new
+void chip_free(struct chip8 *chip);
+
+// Reset the CXNN random number generator. chip_init seeds from the clock, so anything that needs to reproduce a run
+// (see movie.h) has to seed it explicitly
+void chip_seed(struct chip8 *chip, u32 seed);
+
+// Free anything chip_init/chip_run allocated. The struct itself is left to the caller
+void chip_deinit(struct chip8 *chip);
+
+// Pick the interpreter profile. Switching to or from XO-CHIP resizes memory (keeping the first 4KB), so do it before
+// chip_load. Returns false, leaving the machine as it was, if the 64KB couldn't be allocated
+bool chip_set_quirks(struct chip8 *chip, enum chip_quirks quirks);
+
+// Load a program into the CHIP-8 given a path to the file. Nothing changes unless it returns CHIP_OK
+enum chip_error chip_load(struct chip8 *chip, const char *program);
+
+// Load a program from a buffer (copied, programs are free to overwrite themselves) or a shared ROM image
+enum chip_error chip_load_mem(struct chip8 *chip, const u8 *program, size_t size);
+enum chip_error chip_load_rom(struct chip8 *chip, const struct chip_rom *rom);
+
+// Map a ROM file read-only. Returns NULL with *err set on failure
+struct chip_rom *chip_rom_open(const char *path, enum chip_error *err);
+
+// A ROM image over a buffer the caller keeps alive until chip_rom_close. Returns NULL if out of memory
+struct chip_rom *chip_rom_wrap(const u8 *data, size_t size);
+
+// Release a ROM image, machines loaded from it are unaffected
+void chip_rom_close(struct chip_rom *rom);
+
+// Human readable chip_error. CHIP_ERR_IO is strerror(errno), so ask before anything else can change errno
+const char *chip_strerror(enum chip_error err);
 
 // Execute one instruction cycle. Returns a bool as to whether the screen should be redrawn
-// Takes in a bitmask for each key (eg key 9 is key_mask & (1 << 9)) and a deltatime in ms since last call
+// Takes in a bitmask for each key (eg key 9 is key_mask & (1 << 9)) and a deltatime in ms since last call.
+// The delay and sound timers tick at 60Hz of accumulated deltatime; pass 0 and call chip_tick to drive them yourself
 bool chip_cycle(struct chip8 *chip, u16 key_mask, u16 deltatime);
+
+// One 60Hz timer tick: decrement the delay and sound timers if they're running
+void chip_tick(struct chip8 *chip);
+
+// Execute `cycles` instructions through the pre-decoded cache. Behaves exactly like calling chip_cycle `cycles` times
+// with the same key_mask and deltatime, and returns whether any of them asked for a redraw.
+// Idle loops (see enum chip_idle) are jumped over rather than run, ending up in the same state they would have
+bool chip_run(struct chip8 *chip, u16 key_mask, u16 deltatime, u32 cycles);
+
+// Drop the decoded form of mem[addr..addr+len). chip_mem_write does this itself
+void chip_invalidate(struct chip8 *chip, u16 addr, u16 len);
+
+// Copy len bytes out of / into memory from addr, wrapping at the end. Writing unshares pages (see chip_fork) and
+// invalidates whatever it changed, so nothing else is needed after it
+void chip_mem_read(const struct chip8 *chip, u16 addr, u8 *out, size_t len);
+void chip_mem_write(struct chip8 *chip, u16 addr, const u8 *data, size_t len);
+
+// Start `child` (uninitialised) as a copy of `parent`. Registers, timers and the display are copied, memory pages and
+// the decoded cache are shared and only copied when one side writes to them, so a fork of a running machine is a few
+// hundred bytes. chip_deinit the child to discard it, in any order relative to the parent.
+// Time scales with memory though: fork and discard take a reference on every page and drop it again, about 120ns for
+// a 4KB machine but 1.2us for XO-CHIP's 256 pages, so a search forking per node should expect that on XO programs.
+// Reference counts aren't atomic: a parent and all its forks have to stay on one thread. Returns false if out of memory
+bool chip_fork(struct chip8 *parent, struct chip8 *child);
+
+// Bytes of memory pages and decoded cache this machine uses on top of the struct itself. Anything shared is split
+// evenly between its users, fractions included, so summing this over a tree of forks gives what the tree really costs
+// however many forks there are
+double chip_footprint(const struct chip8 *chip);
@@ -0,0 +1,854 @@
+// Not a normal header: chip8.c includes this once per quirk profile, with CORE(name) giving each copy its own names
+// and the QUIRK_* macros set to 0/1. Every quirk is resolved by the preprocessor, so the interpreters below never test
+// a quirk at runtime. See chip_quirks in chip8.h for what each one means
+
+// Every address wraps at the end of memory, 4KB or XO-CHIP's 64KB
+#if QUIRK_XO
+#define MEM_MASK 0xFFFF
+#else
+#define MEM_MASK 0xFFF
+#endif
+
+// Conditional skips step over F000 NNNN as a whole on XO-CHIP, pc already points past the skip itself
+#if QUIRK_XO
+#define SKIP_LEN(pc) ((CHIP_MEM(chip, (pc) & MEM_MASK) == 0xF0 && CHIP_MEM(chip, ((pc) + 1) & MEM_MASK) == 0x00) ? 4 : 2)
+#else
+#define SKIP_LEN(pc) 2
+#endif
+#define SKIP() (chip->pc += SKIP_LEN(chip->pc))
+
+// DXYN/DXY0 on one bitplane, in whichever resolution the chip is in
+static inline u8 CORE(draw_plane)(struct chip8 *chip, u64 *plane, u16 addr, u8 vx, u8 vy, u8 rows, bool wide)
+{
+#if QUIRK_SUPER
+    if (chip->hires)
+        return chip_draw_hires(chip, plane, addr, MEM_MASK, vx % DISPLAY_HI_W, vy % DISPLAY_HI_H, rows, wide, QUIRK_CLIP);
+#endif
+    return chip_draw(chip, plane, addr, MEM_MASK, vx % DISPLAY_W, vy % DISPLAY_H, rows, wide, QUIRK_CLIP);
+}
+
+// DXYN for this profile, returns vF. QUIRK_SUPER: DXY0 draws a 16x16 sprite. QUIRK_XO: each selected plane gets its own
+// sprite, stored one after the other from i
+static inline u8 CORE(draw)(struct chip8 *chip, u8 vx, u8 vy, u8 n)
+{
+#if QUIRK_SUPER
+    if (n == 0) {
+#if QUIRK_XO
+        u8 hit = 0;
+        u16 addr = chip->i;
+        for (int p = 0; p < 2; p++) {
+            u64 *plane = chip_plane(chip, p);
+            if (plane) {
+                hit |= CORE(draw_plane)(chip, plane, addr, vx, vy, 16, true);
+                addr += 32;
+            }
+        }
+        return hit;
+#else
+        return CORE(draw_plane)(chip, chip->display, chip->i, vx, vy, 16, true);
+#endif
+    }
+#endif
+#if QUIRK_XO
+    u8 hit = 0;
+    u16 addr = chip->i;
+    for (int p = 0; p < 2; p++) {
+        u64 *plane = chip_plane(chip, p);
+        if (plane) {
+            hit |= CORE(draw_plane)(chip, plane, addr, vx, vy, n, false);
+            addr += n;
+        }
+    }
+    return hit;
+#else
+    return CORE(draw_plane)(chip, chip->display, chip->i, vx, vy, n, false);
+#endif
+}
+
+static bool CORE(cycle)(struct chip8 *chip, u16 key_mask, u16 deltatime)
+{
+    // Fetch
+    u16 instruction = (CHIP_MEM(chip, chip->pc & MEM_MASK) << 8) | CHIP_MEM(chip, (chip->pc+1) & MEM_MASK);
+    PROFILE_HIT(chip, chip->pc, instruction);
+    chip->pc += 2;
+    chip->pc &= MEM_MASK; // Bound to 12 bits (16 on XO-CHIP)
+
+    // Decode
+    u16 opcode = (instruction >> 12);
+    u16  x     = (instruction >> 8) & 0x0F;
+    u16   y    = (instruction >> 4) & 0x0F;
+    u16    n   = instruction & 0x000F;
+    u16   nn   = instruction & 0x00FF;
+    u16  nnn   = instruction & 0x0FFF;
+
+    // Execute
+    u8 *v = chip->v; // Convenience
+    bool redraw = false;
+    switch (opcode) {
+        case 0x0:
+            switch (instruction) {
+                case 0x00E0:
+                    // Clear screen
+                    chip_clear(chip);
+                    redraw = true;
+                    break;
+                case 0x00EE:
+                    // Return from subroutine
+                    chip->pc = chip->stack[--chip->sp];
+                    break;
+#if QUIRK_SUPER
+                case 0x00FB:
+                    // 00FB: Scroll right 4 pixels
+                    chip_scroll_right(chip);
+                    redraw = true;
+                    break;
+                case 0x00FC:
+                    // 00FC: Scroll left 4 pixels
+                    chip_scroll_left(chip);
+                    redraw = true;
+                    break;
+                case 0x00FD:
+                    // 00FD: Exit, park on this instruction and let the frontend notice
+                    chip->halted = true;
+                    chip->pc = (chip->pc - 2) & MEM_MASK;
+                    break;
+                case 0x00FE:
+                    // 00FE: Lo-res mode
+                    chip_set_hires(chip, false);
+                    redraw = true;
+                    break;
+                case 0x00FF:
+                    // 00FF: Hi-res mode
+                    chip_set_hires(chip, true);
+                    redraw = true;
+                    break;
+                default:
+                    // 00CN: Scroll down N rows
+                    if ((instruction & 0xFFF0) == 0x00C0) {
+                        chip_scroll_vertical(chip, n, true);
+                        redraw = true;
+                    }
+#if QUIRK_XO
+                    // 00DN: Scroll up N rows
+                    if ((instruction & 0xFFF0) == 0x00D0) {
+                        chip_scroll_vertical(chip, n, false);
+                        redraw = true;
+                    }
+#endif
+                    break;
+#endif
+            }
+            break;
+        case 0x1:
+            // 1NNN: Jump to 0xNNN
+            chip->pc = nnn;
+            break;
+        case 0x2:
+            // 2NNN: Call subroutine at 0xNNN
+            chip->stack[chip->sp++] = chip->pc;
+            chip->pc = nnn;
+            break;
+        case 0x3:
+            // 3XNN: Skip next if vX == NN
+            if (v[x] == nn)
+                SKIP();
+            break;
+        case 0x4:
+            // 4XNN: Skip next if vX != NN
+            if (v[x] != nn)
+                SKIP();
+            break;
+        case 0x5:
+#if QUIRK_XO
+            if (n == 0x2) {
+                // 5XY2: Store vX..vY into mem starting from i, leaving i alone
+                int count = (x <= y ? y - x : x - y) + 1;
+                for (int k = 0; k < count; k++)
+                    chip_poke(chip, (chip->i + k) & MEM_MASK, v[chip_range(x, y, k)]);
+                chip_invalidate(chip, chip->i, count);
+                break;
+            }
+            if (n == 0x3) {
+                // 5XY3: Load vX..vY from mem starting from i, leaving i alone
+                int count = (x <= y ? y - x : x - y) + 1;
+                for (int k = 0; k < count; k++)
+                    v[chip_range(x, y, k)] = CHIP_MEM(chip, (chip->i + k) & MEM_MASK);
+                break;
+            }
+#endif
+            // 5XY0: Skip next if vX == vY
+            if (v[x] == v[y])
+                SKIP();
+            break;
+        case 0x6:
+            // 6XNN: Set vX = NN
+            v[x] = nn;
+            break;
+        case 0x7:
+            // 7XNN: Add NN to vX, without carry
+            v[x] += nn;
+            break;
+        case 0x8:
+            // Arithmetic instructions, n conveniently also denotes which one!
+            switch (n) {
+                case 0x0:
+                    // 8XY0: Set vX = vY
+                    v[x] = v[y];
+                    break;
+                case 0x1:
+                    // 8XY1: OR, vX |= vY
+                    v[x] |= v[y];
+#if QUIRK_LOGIC_VF
+                    v[0xF] = 0;
+#endif
+                    break;
+                case 0x2:
+                    // 8XY2: AND, vX &= vY
+                    v[x] &= v[y];
+#if QUIRK_LOGIC_VF
+                    v[0xF] = 0;
+#endif
+                    break;
+                case 0x3:
+                    // 8XY3: XOR, vX ^= vY
+                    v[x] ^= v[y];
+#if QUIRK_LOGIC_VF
+                    v[0xF] = 0;
+#endif
+                    break;
+                case 0x4:
+                    // 8XY4: Add, vX += vY
+                    v[x] += v[y];
+                    v[0xF] = (v[x] < v[y]); // Overflow detection!
+                    break;
+                case 0x5:
+                    // 8XY5: Subtract, vX -= vY
+                    u8 flag5 = (v[x] >= v[y]) ? 1 : 0;
+                    v[x] -= v[y];
+                    v[0xF] = flag5;
+                    break;
+                case 0x6:
+                    // 8XY6: Shift, vX = vY >> 1, setting vF to the shifted out bit
+                    // QUIRK_SHIFT_VX: SUPER-CHIP shifts vX in place and ignores vY
+#if !QUIRK_SHIFT_VX
+                    v[x] = v[y];
+#endif
+                    u8 carry6 = (v[x] & 0x1);
+                    v[x] >>= 1;
+                    v[0xF] = carry6;
+                    break;
+                case 0x7:
+                    // 8XY7: Subtract, vX = vY - vX
+                    u8 flag8 = (v[y] >= v[x]) ? 1 : 0;
+                    v[x] = v[y] - v[x];
+                    v[0xF] = flag8;
+                    break;
+                case 0xE:
+                    // 8XYE: Shift, vX = vY << 1, setting vF to the shifted out bit
+                    // QUIRK_SHIFT_VX: SUPER-CHIP shifts vX in place and ignores vY
+#if !QUIRK_SHIFT_VX
+                    v[x] = v[y];
+#endif
+                    u8 carryE = (v[x] & 0x80) >> 7;
+                    v[x] <<= 1;
+                    v[0xF] = carryE;
+                    break;
+            }
+            break;
+        case 0x9:
+            // 9XY0: Skip next if vX != vY
+            if (v[x] != v[y])
+                SKIP();
+            break;
+        case 0xA:
+            // ANNN: Set index
+            chip->i = nnn;
+            break;
+        case 0xB:
+            // BNNN: Jump with offset
+            // QUIRK_JUMP_VX: SUPER-CHIP reads it as BXNN and offsets by vX
+#if QUIRK_JUMP_VX
+            chip->pc = (nnn + v[x]) & MEM_MASK;
+#else
+            chip->pc = (nnn + v[0]) & MEM_MASK;
+#endif
+            break;
+        case 0xC:
+            // CXNN: Random
+            v[x] = chip_rand(chip) & nn;
+            break;
+        case 0xD:
+            // DXYN: Display
+            v[0xF] = CORE(draw)(chip, v[x], v[y], n);
+            chip->draws++;
+
+            redraw = true;
+            break;
+        case 0xE:
+            // EXnn: Skip if key instructions, nn is already conveniently decoded!
+            switch (nn) {
+                case 0x9E:
+                    // EX9E: Skip if key in vX is pressed
+                    if ((key_mask & (1 << v[x])) > 0)
+                        SKIP();
+                    break;
+                case 0xA1:
+                    // EXA1: Skip if key in vX is NOT pressed
+                    if ((key_mask & (1 << v[x])) == 0)
+                        SKIP();
+                    break;
+            }
+            break;
+        case 0xF:
+            // FXnn: Timers, index add, get key, font char, BCD convert and mem store/loads
+            switch (nn) {
+                // Timers
+                case 0x07:
+                    // FX07: Set vX = current value of delay timer
+                    v[x] = chip->delay;
+                    break;
+                case 0x15:
+                    // FX15: Set delay timer = vX
+                    chip->delay = v[x];
+                    break;
+                case 0x18:
+                    // FX18: Set sound timer = vX
+                    chip->sound = v[x];
+                    break;
+                
+                case 0x1E:
+                    // FX1E: Add to index
+                    // QUIRK_ADDI_CARRY: the Amiga interpreter set vF on overflow past 0xFFF, others leave it alone
+                    // XO-CHIP's i is 16 bits (F000 NNNN), so only the classic profiles wrap at 0xFFF
+                    u32 sum1E = chip->i + v[x];
+#if QUIRK_ADDI_CARRY
+                    v[0xF] = (sum1E > MEM_MASK);
+#endif
+                    chip->i = sum1E & MEM_MASK;
+                    break;
+                
+                case 0x0A:
+                    // FX0A: Get key
+                    if (key_mask == 0) {
+                        chip->pc -= 2;
+                    }
+                    else {
+                        // Find the pressed key
+                        for (int i = 0; i < 16; i++) {
+                            if (key_mask & (1 << i)) {
+                                v[x] = i;
+                                break;
+                            }
+                        }
+                    }
+                    break;
+                
+                case 0x29:
+                    // FX29: Font character, i = &hex_char[X]
+                    chip->i = font_addr + v[x]*5;
+                    break;
+                
+                case 0x33:
+                    // FX33: BCD convert
+                    chip_poke(chip,  chip->i    & MEM_MASK,  v[x] / 100);
+                    chip_poke(chip, (chip->i+1) & MEM_MASK, (v[x] / 10) % 10);
+                    chip_poke(chip, (chip->i+2) & MEM_MASK,  v[x] % 10);
+                    chip_invalidate(chip, chip->i, 3);
+                    break;
+                
+                case 0x55:
+                    // FX55: Store registers from v0-vX into mem starting from i
+                    // QUIRK_LOAD_STORE_INC: the original CHIP8 leaves i pointing past the last register
+                    for (int i = 0; i <= x; i++)
+                        chip_poke(chip, (chip->i + i) & MEM_MASK, v[i]);
+                    chip_invalidate(chip, chip->i, x + 1);
+#if QUIRK_LOAD_STORE_INC
+                    chip->i = (chip->i + x + 1) & MEM_MASK;
+#endif
+                    break;
+                case 0x65:
+                    // FX65: Load registers to v0-vX from mem starting from i
+                    // QUIRK_LOAD_STORE_INC: the original CHIP8 leaves i pointing past the last register
+                    for (int i = 0; i <= x; i++)
+                        v[i] = CHIP_MEM(chip, (chip->i + i) & MEM_MASK);
+#if QUIRK_LOAD_STORE_INC
+                    chip->i = (chip->i + x + 1) & MEM_MASK;
+#endif
+                    break;
+#if QUIRK_SUPER
+                case 0x30:
+                    // FX30: Big font character, i = &big_hex_char[X]
+                    chip->i = font_big_addr + (v[x] & 0xF)*10;
+                    break;
+                case 0x75:
+                    // FX75: Save v0-vX to the RPL flags
+                    memcpy(chip->rpl, v, x + 1);
+                    break;
+                case 0x85:
+                    // FX85: Load v0-vX from the RPL flags
+                    memcpy(v, chip->rpl, x + 1);
+                    break;
+#endif
+#if QUIRK_XO
+                case 0x00:
+                    // F000 NNNN: i = NNNN, the address is the next word
+                    if (x == 0) {
+                        chip->i = (CHIP_MEM(chip, chip->pc & MEM_MASK) << 8) | CHIP_MEM(chip, (chip->pc + 1) & MEM_MASK);
+                        chip->pc = (chip->pc + 2) & MEM_MASK;
+                    }
+                    break;
+                case 0x01:
+                    // FN01: Select the bitplanes later draws, clears and scrolls work on
+                    chip->planes = x & 3;
+                    break;
+                case 0x02:
+                    // F002: Load the 16 byte audio pattern from mem starting from i
+                    if (x == 0) {
+                        for (int i = 0; i < 16; i++)
+                            chip->pattern[i] = CHIP_MEM(chip, (chip->i + i) & MEM_MASK);
+                        chip->pattern_loaded = true;
+                    }
+                    break;
+                case 0x3A:
+                    // FX3A: Audio pattern pitch = vX
+                    chip->pitch = v[x];
+                    break;
+#endif
+            }
+    }
+
+    // Timer logic
+    chip_advance(chip, deltatime);
+
+    return redraw;
+}
+
+static bool CORE(run)(struct chip8 *chip, u16 key_mask, u16 deltatime, u32 cycles)
+{
+    bool redraw = false;
+
+    // Computed goto (a GCC extension, like the rest of the build) so every handler ends in its own indirect jump,
+    // which the branch predictor handles far better than one shared switch
+    static void *const handlers[] = {
+        [OP_DECODE] = &&op_decode, [OP_NOP] = &&op_nop,
+        [OP_00E0] = &&op_00E0, [OP_00EE] = &&op_00EE, [OP_1NNN] = &&op_1NNN, [OP_2NNN] = &&op_2NNN,
+        [OP_3XNN] = &&op_3XNN, [OP_4XNN] = &&op_4XNN, [OP_5XY0] = &&op_5XY0, [OP_6XNN] = &&op_6XNN,
+        [OP_7XNN] = &&op_7XNN,
+        [OP_8XY0] = &&op_8XY0, [OP_8XY1] = &&op_8XY1, [OP_8XY2] = &&op_8XY2, [OP_8XY3] = &&op_8XY3,
+        [OP_8XY4] = &&op_8XY4, [OP_8XY5] = &&op_8XY5, [OP_8XY6] = &&op_8XY6, [OP_8XY7] = &&op_8XY7,
+        [OP_8XYE] = &&op_8XYE,
+        [OP_9XY0] = &&op_9XY0, [OP_ANNN] = &&op_ANNN, [OP_BNNN] = &&op_BNNN, [OP_CXNN] = &&op_CXNN,
+        [OP_DXYN] = &&op_DXYN, [OP_EX9E] = &&op_EX9E, [OP_EXA1] = &&op_EXA1,
+        [OP_FX07] = &&op_FX07, [OP_FX0A] = &&op_FX0A, [OP_FX15] = &&op_FX15, [OP_FX18] = &&op_FX18,
+        [OP_FX1E] = &&op_FX1E, [OP_FX29] = &&op_FX29, [OP_FX33] = &&op_FX33, [OP_FX55] = &&op_FX55,
+        [OP_FX65] = &&op_FX65,
+        [OP_00CN] = &&op_00CN, [OP_00FB] = &&op_00FB, [OP_00FC] = &&op_00FC, [OP_00FD] = &&op_00FD,
+        [OP_00FE] = &&op_00FE, [OP_00FF] = &&op_00FF, [OP_FX30] = &&op_FX30, [OP_FX75] = &&op_FX75,
+        [OP_FX85] = &&op_FX85,
+        [OP_00DN] = &&op_00DN, [OP_5XY2] = &&op_5XY2, [OP_5XY3] = &&op_5XY3, [OP_F000] = &&op_F000,
+        [OP_FN01] = &&op_FN01, [OP_F002] = &&op_F002, [OP_FX3A] = &&op_FX3A,
+    };
+
+    struct chip_cache *cache = chip->cache;
+    struct chip_op *ops = cache->ops;
+    struct chip_block *blocks = cache->blocks;
+    struct chip_op *op;
+    u8 *v = chip->v;
+    u8 x, y;
+    u16 pc = chip->pc; // Only written back on the way out, so a jump doesn't have to wait for its own store to land
+    u16 in_block = 0; // Ops left in the block being run, including the current one
+    u64 block_insns = 0, step_insns = 0, idle_insns = 0; // Kept local so the hot path doesn't write through cache
+
+    // Inside a block: jump straight on to the next op, the block entry already did the pc/timer/budget bookkeeping.
+    // Otherwise: same timer logic as the end of chip_cycle, then go fetch the next op
+    #define DISPATCH() \
+        do { \
+            if (in_block) { \
+                if (--in_block == 0) \
+                    goto fetch; \
+                op++; \
+                x = op->x; \
+                y = op->y; \
+                goto *handlers[op->handler]; \
+            } \
+            if (deltatime) \
+                chip_advance(chip, deltatime); \
+            goto fetch; \
+        } while (0)
+
+    // After a memory write. Writing to a page shared with a fork also gives this machine its own copy of a shared
+    // cache (see chip_page_unshare), so pick up the new one. Writes always end a block, so only fetch needs it
+    // A skip taken partway through a block leaves it there: pc goes back to just after the skip before skipping, and
+    // the ops that won't run now are handed back to the budget and the timer
+    #define BLOCK_SKIP() \
+        do { \
+            if (in_block > 1) { \
+                u32 left = in_block - 1; \
+                pc = ((op - ops)*2 + 2) & MEM_MASK; \
+                cycles += left; \
+                block_insns -= left; \
+                if (deltatime) \
+                    chip->timer -= left*deltatime*60; \
+                in_block = 1; \
+            } \
+            pc += SKIP_LEN(pc); \
+        } while (0)
+
+    #define DISPATCH_WRITTEN() \
+        do { \
+            cache = chip->cache; \
+            ops = cache->ops; \
+            blocks = cache->blocks; \
+            DISPATCH(); \
+        } while (0)
+
+fetch:
+    if (cycles == 0)
+        goto done;
+    if (pc & 1) {
+        cycles--;
+        chip->pc = pc;
+        redraw |= CORE(cycle)(chip, key_mask, deltatime);
+        pc = chip->pc;
+        cache = chip->cache;
+        ops = cache->ops;
+        blocks = cache->blocks;
+        goto fetch;
+    }
+
+    // Run the whole block in one go, unless the budget ends or a timer ticks somewhere inside it
+    u16 start = pc & MEM_MASK;
+    struct chip_block *block = &blocks[start >> 1];
+    u16 len = block->len ? block->len : chip_translate(chip, start);
+    if (block->idle) {
+        chip->pc = pc;
+        u32 skipped = chip_idle_skip(chip, block->idle, start, key_mask, deltatime, cycles);
+        pc = chip->pc;
+        if (skipped) {
+            idle_insns += skipped;
+            cycles -= skipped;
+            if (cycles == 0)
+                chip->idle = block->idle;
+            goto fetch;
+        }
+    }
+    if (len <= cycles && (deltatime == 0 || chip->timer + (u32)len*deltatime*60 < 1000)) {
+        block_insns += len;
+        cycles -= len;
+        if (deltatime)
+            chip->timer += (u32)len*deltatime*60;
+
+        op = &ops[start >> 1];
+        pc = (start + len*2) & MEM_MASK;
+        in_block = len;
+        x = op->x;
+        y = op->y;
+        goto *handlers[op->handler];
+    }
+
+    cycles--;
+    step_insns++;
+    op = &ops[start >> 1];
+    pc = (start + 2) & MEM_MASK;
+    x = op->x;
+    y = op->y;
+    goto *handlers[op->handler];
+
+op_decode:
+    chip_decode(chip, (op - ops)*2, op);
+    x = op->x;
+    y = op->y;
+    goto *handlers[op->handler];
+
+op_nop:
+    DISPATCH();
+op_00E0:
+    chip_clear(chip);
+    redraw = true;
+    DISPATCH();
+op_00EE:
+    pc = chip->stack[--chip->sp];
+    DISPATCH();
+op_1NNN:
+    pc = op->nnn;
+    DISPATCH();
+op_2NNN:
+    chip->stack[chip->sp++] = pc;
+    pc = op->nnn;
+    DISPATCH();
+op_3XNN:
+    if (v[x] == (op->nnn & 0xFF))
+        BLOCK_SKIP();
+    DISPATCH();
+op_4XNN:
+    if (v[x] != (op->nnn & 0xFF))
+        BLOCK_SKIP();
+    DISPATCH();
+op_5XY0:
+    if (v[x] == v[y])
+        BLOCK_SKIP();
+    DISPATCH();
+op_6XNN:
+    v[x] = op->nnn & 0xFF;
+    DISPATCH();
+op_7XNN:
+    v[x] += op->nnn & 0xFF;
+    DISPATCH();
+op_8XY0:
+    v[x] = v[y];
+    DISPATCH();
+op_8XY1:
+    v[x] |= v[y];
+#if QUIRK_LOGIC_VF
+    v[0xF] = 0;
+#endif
+    DISPATCH();
+op_8XY2:
+    v[x] &= v[y];
+#if QUIRK_LOGIC_VF
+    v[0xF] = 0;
+#endif
+    DISPATCH();
+op_8XY3:
+    v[x] ^= v[y];
+#if QUIRK_LOGIC_VF
+    v[0xF] = 0;
+#endif
+    DISPATCH();
+op_8XY4:
+    v[x] += v[y];
+    v[0xF] = (v[x] < v[y]);
+    DISPATCH();
+op_8XY5: {
+    u8 flag = (v[x] >= v[y]) ? 1 : 0;
+    v[x] -= v[y];
+    v[0xF] = flag;
+    DISPATCH();
+}
+op_8XY6: {
+#if !QUIRK_SHIFT_VX
+    v[x] = v[y];
+#endif
+    u8 carry = v[x] & 0x1;
+    v[x] >>= 1;
+    v[0xF] = carry;
+    DISPATCH();
+}
+op_8XY7: {
+    u8 flag = (v[y] >= v[x]) ? 1 : 0;
+    v[x] = v[y] - v[x];
+    v[0xF] = flag;
+    DISPATCH();
+}
+op_8XYE: {
+#if !QUIRK_SHIFT_VX
+    v[x] = v[y];
+#endif
+    u8 carry = (v[x] & 0x80) >> 7;
+    v[x] <<= 1;
+    v[0xF] = carry;
+    DISPATCH();
+}
+op_9XY0:
+    if (v[x] != v[y])
+        BLOCK_SKIP();
+    DISPATCH();
+op_ANNN:
+    chip->i = op->nnn;
+    DISPATCH();
+op_BNNN:
+#if QUIRK_JUMP_VX
+    pc = (op->nnn + v[x]) & MEM_MASK;
+#else
+    pc = (op->nnn + v[0]) & MEM_MASK;
+#endif
+    DISPATCH();
+op_CXNN:
+    v[x] = chip_rand(chip) & op->nnn;
+    DISPATCH();
+op_DXYN:
+    v[0xF] = CORE(draw)(chip, v[x], v[y], op->n);
+    chip->draws++;
+    redraw = true;
+    DISPATCH();
+op_EX9E:
+    if ((key_mask & (1 << v[x])) > 0)
+        BLOCK_SKIP();
+    DISPATCH();
+op_EXA1:
+    if ((key_mask & (1 << v[x])) == 0)
+        BLOCK_SKIP();
+    DISPATCH();
+op_FX07:
+    v[x] = chip->delay;
+    DISPATCH();
+op_FX0A:
+    if (key_mask == 0) {
+        pc -= 2;
+    }
+    else {
+        for (int i = 0; i < 16; i++) {
+            if (key_mask & (1 << i)) {
+                v[x] = i;
+                break;
+            }
+        }
+    }
+    DISPATCH();
+op_FX15:
+    chip->delay = v[x];
+    DISPATCH();
+op_FX18:
+    chip->sound = v[x];
+    DISPATCH();
+op_FX1E: {
+    u32 sum = chip->i + v[x];
+#if QUIRK_ADDI_CARRY
+    v[0xF] = (sum > MEM_MASK);
+#endif
+    chip->i = sum & MEM_MASK;
+    DISPATCH();
+}
+op_FX29:
+    chip->i = font_addr + v[x]*5;
+    DISPATCH();
+op_FX33:
+    chip_poke(chip,  chip->i    & MEM_MASK,  v[x] / 100);
+    chip_poke(chip, (chip->i+1) & MEM_MASK, (v[x] / 10) % 10);
+    chip_poke(chip, (chip->i+2) & MEM_MASK,  v[x] % 10);
+    chip_invalidate(chip, chip->i, 3);
+    DISPATCH_WRITTEN();
+op_FX55:
+    chip_store_range(chip, chip->i, MEM_MASK, v, x + 1);
+    chip_invalidate(chip, chip->i, x + 1);
+#if QUIRK_LOAD_STORE_INC
+    chip->i = (chip->i + x + 1) & MEM_MASK;
+#endif
+    DISPATCH_WRITTEN();
+op_FX65:
+    chip_load_range(chip, chip->i, MEM_MASK, v, x + 1);
+#if QUIRK_LOAD_STORE_INC
+    chip->i = (chip->i + x + 1) & MEM_MASK;
+#endif
+    DISPATCH();
+
+    // SUPER-CHIP, plain no-ops for the other profiles like they always were
+op_00CN:
+#if QUIRK_SUPER
+    chip_scroll_vertical(chip, op->n, true);
+    redraw = true;
+#endif
+    DISPATCH();
+op_00FB:
+#if QUIRK_SUPER
+    chip_scroll_right(chip);
+    redraw = true;
+#endif
+    DISPATCH();
+op_00FC:
+#if QUIRK_SUPER
+    chip_scroll_left(chip);
+    redraw = true;
+#endif
+    DISPATCH();
+op_00FD:
+#if QUIRK_SUPER
+    chip->halted = true;
+    pc = (pc - 2) & MEM_MASK;
+#endif
+    DISPATCH();
+op_00FE:
+#if QUIRK_SUPER
+    chip_set_hires(chip, false);
+    redraw = true;
+#endif
+    DISPATCH();
+op_00FF:
+#if QUIRK_SUPER
+    chip_set_hires(chip, true);
+    redraw = true;
+#endif
+    DISPATCH();
+op_FX30:
+#if QUIRK_SUPER
+    chip->i = font_big_addr + (v[x] & 0xF)*10;
+#endif
+    DISPATCH();
+op_FX75:
+#if QUIRK_SUPER
+    memcpy(chip->rpl, v, x + 1);
+#endif
+    DISPATCH();
+op_FX85:
+#if QUIRK_SUPER
+    memcpy(v, chip->rpl, x + 1);
+#endif
+    DISPATCH();
+
+    // XO-CHIP. 5XY2/5XY3 were always decoded as 5XY0 before, the others as no-ops
+op_00DN:
+#if QUIRK_XO
+    chip_scroll_vertical(chip, op->n, false);
+    redraw = true;
+#endif
+    DISPATCH();
+op_5XY2: {
+#if QUIRK_XO
+    int count = (x <= y ? y - x : x - y) + 1;
+    for (int k = 0; k < count; k++)
+        chip_poke(chip, (chip->i + k) & MEM_MASK, v[chip_range(x, y, k)]);
+    chip_invalidate(chip, chip->i, count);
+    DISPATCH_WRITTEN();
+#else
+    goto op_5XY0;
+#endif
+}
+op_5XY3: {
+#if QUIRK_XO
+    int count = (x <= y ? y - x : x - y) + 1;
+    for (int k = 0; k < count; k++)
+        v[chip_range(x, y, k)] = CHIP_MEM(chip, (chip->i + k) & MEM_MASK);
+    DISPATCH();
+#else
+    goto op_5XY0;
+#endif
+}
+op_F000:
+#if QUIRK_XO
+    chip->i = (CHIP_MEM(chip, pc & MEM_MASK) << 8) | CHIP_MEM(chip, (pc + 1) & MEM_MASK);
+    pc = (pc + 2) & MEM_MASK;
+#endif
+    DISPATCH();
+op_FN01:
+#if QUIRK_XO
+    chip->planes = x & 3;
+#endif
+    DISPATCH();
+op_F002:
+#if QUIRK_XO
+    for (int i = 0; i < 16; i++)
+        chip->pattern[i] = CHIP_MEM(chip, (chip->i + i) & MEM_MASK);
+    chip->pattern_loaded = true;
+#endif
+    DISPATCH();
+op_FX3A:
+#if QUIRK_XO
+    chip->pitch = v[x];
+#endif
+    DISPATCH();
+
+    #undef DISPATCH
+    #undef BLOCK_SKIP
+    #undef DISPATCH_WRITTEN
+
+done:
+    chip->pc = pc;
+    cache->block_insns += block_insns;
+    cache->step_insns += step_insns;
+    cache->idle_insns += idle_insns;
+    return redraw;
+}
+
+#undef MEM_MASK
+#undef SKIP
+#undef SKIP_LEN
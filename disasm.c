@@ -0,0 +1,82 @@
+#include "disasm.h"
+#include <stdio.h>
+
+char *chip_disasm(u16 instruction, enum chip_quirks quirks, char *buf, size_t size)
+{
+    bool super = quirks == QUIRKS_SCHIP || quirks == QUIRKS_XO;
+    bool xo = quirks == QUIRKS_XO;
+    u16 x   = (instruction >> 8) & 0x0F;
+    u16 y   = (instruction >> 4) & 0x0F;
+    u16 n   = instruction & 0x000F;
+    u16 nn  = instruction & 0x00FF;
+    u16 nnn = instruction & 0x0FFF;
+
+    switch (instruction >> 12) {
+        case 0x0:
+            if (instruction == 0x00E0) { snprintf(buf, size, "CLS"); return buf; }
+            if (instruction == 0x00EE) { snprintf(buf, size, "RET"); return buf; }
+            if (super && instruction == 0x00FB) { snprintf(buf, size, "SCR"); return buf; }
+            if (super && instruction == 0x00FC) { snprintf(buf, size, "SCL"); return buf; }
+            if (super && instruction == 0x00FD) { snprintf(buf, size, "EXIT"); return buf; }
+            if (super && instruction == 0x00FE) { snprintf(buf, size, "LOW"); return buf; }
+            if (super && instruction == 0x00FF) { snprintf(buf, size, "HIGH"); return buf; }
+            if (super && (instruction & 0xFFF0) == 0x00C0) { snprintf(buf, size, "SCD %d", n); return buf; }
+            if (xo && (instruction & 0xFFF0) == 0x00D0) { snprintf(buf, size, "SCU %d", n); return buf; }
+            break;
+        case 0x1: snprintf(buf, size, "JP 0x%03X", nnn); return buf;
+        case 0x2: snprintf(buf, size, "CALL 0x%03X", nnn); return buf;
+        case 0x3: snprintf(buf, size, "SE V%X, 0x%02X", x, nn); return buf;
+        case 0x4: snprintf(buf, size, "SNE V%X, 0x%02X", x, nn); return buf;
+        case 0x5:
+            if (xo && n == 0x2) { snprintf(buf, size, "SAVE V%X-V%X", x, y); return buf; }
+            if (xo && n == 0x3) { snprintf(buf, size, "LOAD V%X-V%X", x, y); return buf; }
+            snprintf(buf, size, "SE V%X, V%X", x, y);
+            return buf;
+        case 0x6: snprintf(buf, size, "LD V%X, 0x%02X", x, nn); return buf;
+        case 0x7: snprintf(buf, size, "ADD V%X, 0x%02X", x, nn); return buf;
+        case 0x8: {
+            static const char *alu[16] = {
+                [0x0] = "LD", [0x1] = "OR", [0x2] = "AND", [0x3] = "XOR", [0x4] = "ADD",
+                [0x5] = "SUB", [0x6] = "SHR", [0x7] = "SUBN", [0xE] = "SHL",
+            };
+            if (alu[n]) { snprintf(buf, size, "%s V%X, V%X", alu[n], x, y); return buf; }
+            break;
+        }
+        case 0x9: snprintf(buf, size, "SNE V%X, V%X", x, y); return buf;
+        case 0xA: snprintf(buf, size, "LD I, 0x%03X", nnn); return buf;
+        case 0xB:
+            // SUPER-CHIP's BXNN jumps off vX, X being the top nibble of the address. XO-CHIP went back to v0
+            if (quirks == QUIRKS_SCHIP) { snprintf(buf, size, "JP V%X, 0x%03X", x, nnn); return buf; }
+            snprintf(buf, size, "JP V0, 0x%03X", nnn);
+            return buf;
+        case 0xC: snprintf(buf, size, "RND V%X, 0x%02X", x, nn); return buf;
+        case 0xD: snprintf(buf, size, "DRW V%X, V%X, %d", x, y, n); return buf;
+        case 0xE:
+            if (nn == 0x9E) { snprintf(buf, size, "SKP V%X", x); return buf; }
+            if (nn == 0xA1) { snprintf(buf, size, "SKNP V%X", x); return buf; }
+            break;
+        case 0xF:
+            switch (nn) {
+                case 0x07: snprintf(buf, size, "LD V%X, DT", x); return buf;
+                case 0x0A: snprintf(buf, size, "LD V%X, K", x); return buf;
+                case 0x15: snprintf(buf, size, "LD DT, V%X", x); return buf;
+                case 0x18: snprintf(buf, size, "LD ST, V%X", x); return buf;
+                case 0x1E: snprintf(buf, size, "ADD I, V%X", x); return buf;
+                case 0x29: snprintf(buf, size, "LD F, V%X", x); return buf;
+                case 0x33: snprintf(buf, size, "LD B, V%X", x); return buf;
+                case 0x55: snprintf(buf, size, "LD [I], V%X", x); return buf;
+                case 0x65: snprintf(buf, size, "LD V%X, [I]", x); return buf;
+                case 0x30: if (super) { snprintf(buf, size, "LD HF, V%X", x); return buf; } break;
+                case 0x75: if (super) { snprintf(buf, size, "LD R, V%X", x); return buf; } break;
+                case 0x85: if (super) { snprintf(buf, size, "LD V%X, R", x); return buf; } break;
+                case 0x01: if (xo) { snprintf(buf, size, "PLANE %d", x); return buf; } break;
+                case 0x3A: if (xo) { snprintf(buf, size, "PITCH V%X", x); return buf; } break;
+                case 0x00: if (xo && x == 0) { snprintf(buf, size, "LD I, LONG"); return buf; } break; // Address is the next word
+                case 0x02: if (xo && x == 0) { snprintf(buf, size, "AUDIO"); return buf; } break;
+            }
+            break;
+    }
+
+    snprintf(buf, size, "DW 0x%04X", instruction);
+    return buf;
+}
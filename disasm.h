@@ -0,0 +1,7 @@
+#pragma once
+#include "chip8.h"
+#include <stddef.h>
+
+// Write a readable mnemonic for `instruction` into buf (Cowgod's naming), eg "DRW V0, V1, 5". Unknown words come out as
+// "DW 0x1234", and so do SUPER-CHIP and XO-CHIP instructions under profiles that don't run them. Returns buf
+char *chip_disasm(u16 instruction, enum chip_quirks quirks, char *buf, size_t size);
@@ -0,0 +1,135 @@
+#define _POSIX_C_SOURCE 200809L
+#include "export.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+// write() until it's all out, short writes happen on pipes
+static bool write_all(int fd, const u8 *data, size_t size)
+{
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool export_flush(struct frame_export *e)
+{
+    if (e->used > 0 && !write_all(e->fd, e->buffer, e->used))
+        e->failed = true;
+    e->used = 0;
+    return !e->failed;
+}
+
+// Rows as bytes, leftmost pixel in the top bit. With d2 the two planes are ORed together
+static u8 *pack_plane(u8 *out, const u64 *d, const u64 *d2, bool hires)
+{
+    int longs = hires ? DISPLAY_HI_H * 2 : DISPLAY_H;
+    for (int k = 0; k < longs; k++) {
+        u64 row = d[k] | (d2 ? d2[k] : 0);
+        for (int b = 0; b < 8; b++)
+            *out++ = row >> (56 - 8*b);
+    }
+    return out;
+}
+
+bool export_open(struct frame_export *e, enum export_format format, const char *path)
+{
+    e->format = format;
+    e->fd = -1;
+    e->dir = NULL;
+    e->last_size = 0;
+    e->last_width = 0;
+    e->used = 0;
+    e->written = 0;
+    e->duplicates = 0;
+    e->failed = false;
+
+    if (format == EXPORT_PBM) {
+        e->dir = path;
+        return true;
+    }
+
+    e->fd = strcmp(path, "-") == 0 ? STDOUT_FILENO : open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (e->fd < 0)
+        return false;
+    struct export_header header = { .magic = EXPORT_MAGIC, .version = EXPORT_VERSION };
+    memcpy(e->buffer, &header, sizeof(header));
+    e->used = sizeof(header);
+    return true;
+}
+
+bool export_frame(struct frame_export *e, const struct chip8 *chip, u64 frame)
+{
+    if (e->failed)
+        return false;
+
+    // Pack straight into the output buffer when there's room, so a new frame is never copied around
+    u8 scratch[EXPORT_FRAME_MAX];
+    struct export_frame_header header = {
+        .frame = frame,
+        .width = CHIP_W(chip),
+        .height = CHIP_H(chip),
+        .planes = e->format == EXPORT_RAW && chip->quirks == QUIRKS_XO ? 2 : 1,
+    };
+    size_t size = (size_t)header.planes * header.width / 8 * header.height;
+    if (e->format == EXPORT_RAW && e->used + sizeof(header) + size > EXPORT_BUFFER && !export_flush(e))
+        return false;
+    u8 *out = e->format == EXPORT_RAW ? &e->buffer[e->used + sizeof(header)] : scratch;
+
+    if (header.planes == 2)
+        pack_plane(pack_plane(out, chip->display, NULL, chip->hires), chip->display2, NULL, chip->hires);
+    else
+        pack_plane(out, chip->display, chip->quirks == QUIRKS_XO ? chip->display2 : NULL, chip->hires);
+
+    if (size == e->last_size && header.width == e->last_width && memcmp(out, e->last, size) == 0) {
+        e->duplicates++;
+        return true;
+    }
+    memcpy(e->last, out, size);
+    e->last_size = size;
+    e->last_width = header.width;
+    e->written++;
+
+    if (e->format == EXPORT_RAW) {
+        memcpy(&e->buffer[e->used], &header, sizeof(header));
+        e->used += sizeof(header) + size;
+        return true;
+    }
+
+    // One file per frame, the header and pixels go out in a single writev
+    char path[4096], pbm[32];
+    snprintf(path, sizeof(path), "%s/%08llu.pbm", e->dir, (unsigned long long)frame);
+    int len = snprintf(pbm, sizeof(pbm), "P4\n%d %d\n", header.width, header.height);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        e->failed = true;
+        return false;
+    }
+    struct iovec iov[2] = { { pbm, len }, { out, size } };
+    if (writev(fd, iov, 2) != (ssize_t)(len + size))
+        e->failed = true;
+    if (close(fd) != 0)
+        e->failed = true;
+    return !e->failed;
+}
+
+bool export_close(struct frame_export *e)
+{
+    if (e->format == EXPORT_RAW && e->fd >= 0) {
+        export_flush(e);
+        if (e->fd != STDOUT_FILENO && close(e->fd) != 0)
+            e->failed = true;
+    }
+    return !e->failed;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "chip8.h"
+#include <stddef.h>
+
+#define EXPORT_MAGIC   0x53463843 // "C8FS" in a little-endian file
+#define EXPORT_VERSION 1
+#define EXPORT_BUFFER  (1 << 16)  // Raw stream output is batched into writes this big
+
+// Largest packed frame: both planes at 128x64, one bit per pixel
+#define EXPORT_FRAME_MAX (2 * (DISPLAY_HI_W / 8) * DISPLAY_HI_H)
+
+enum export_format {
+    EXPORT_RAW, // One stream: export_header, then an export_frame_header and the packed planes for every frame
+    EXPORT_PBM, // A binary PBM (P4) per frame, named after the frame number. XO-CHIP's planes are ORed together
+};
+
+// Native endian like the other file formats
+struct export_header {
+    u32 magic;
+    u32 version;
+};
+
+struct export_frame_header {
+    u64 frame;  // 60Hz frames since the start, frames skipped as duplicates leave gaps
+    u16 width;
+    u16 height;
+    u8 planes;  // 1, or 2 on XO-CHIP: plane 1's rows come first, then plane 2's
+    u8 pad[3];
+};
+
+// Frames are packed rows, MSB first, exactly what P4 wants. Identical consecutive frames are only written once
+struct frame_export {
+    enum export_format format;
+    int fd;           // EXPORT_RAW's stream
+    const char *dir;  // EXPORT_PBM's directory
+
+    u8 last[EXPORT_FRAME_MAX]; // Previous frame as written, for the duplicate check
+    size_t last_size;
+    u16 last_width;
+
+    u8 buffer[EXPORT_BUFFER];
+    size_t used;
+
+    u64 written;
+    u64 duplicates;
+    bool failed;
+};
+
+// Start exporting to `path`: a file ("-" for stdout) for EXPORT_RAW, an existing directory for EXPORT_PBM.
+// Returns false with errno set on failure. The struct is big, keep it off the stack
+bool export_open(struct frame_export *e, enum export_format format, const char *path);
+
+// Add the current display as frame number `frame`, unless it's the same as the last one. Returns false on write errors
+bool export_frame(struct frame_export *e, const struct chip8 *chip, u64 frame);
+
+// Flush and close, returns false if anything failed to be written
+bool export_close(struct frame_export *e);
@@ -0,0 +1,188 @@
+#define _POSIX_C_SOURCE 200809L
+#include "input.h"
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+
+static long long now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+// Hand-mapping the keys, I can't be bothered to attempt something cleverer. -1 means "quit"
+static int input_map(u8 ch)
+{
+    switch (ch) {
+        case '1': return 0x1;
+        case '2': return 0x2;
+        case '3': return 0x3;
+        case '4': return 0xC;
+
+        case 'q': return 0x4;
+        case 'w': return 0x5;
+        case 'e': return 0x6;
+        case 'r': return 0xD;
+
+        case 'a': return 0x7;
+        case 's': return 0x8;
+        case 'd': return 0x9;
+        case 'f': return 0xE;
+
+        case 'z': return 0xA;
+        case 'x': return 0x0;
+        case 'c': return 0xB;
+        case 'v': return 0xF;
+
+        case 127: case '\b': return INPUT_REWIND;
+    }
+    return -1;
+}
+
+static void input_push(struct input *in, u8 type, u8 key)
+{
+    u32 head = atomic_load_explicit(&in->head, memory_order_relaxed);
+    u32 tail = atomic_load_explicit(&in->tail, memory_order_acquire);
+    if (head - tail == INPUT_RING)
+        return; // Consumer stopped draining, dropping is better than blocking the terminal
+
+    in->ring[head & (INPUT_RING - 1)] = (struct input_event){ .type = type, .key = key };
+    atomic_store_explicit(&in->head, head + 1, memory_order_release);
+}
+
+static void *input_thread(void *arg)
+{
+    struct input *in = arg;
+    long long last_seen[INPUT_REWIND + 1] = {0};
+    u32 held = 0;
+
+    for (;;) {
+        // Sleep until there is input or the next held key runs out
+        long long now = now_ms();
+        int timeout = -1;
+        for (int k = 0; k <= INPUT_REWIND; k++) {
+            if (!(held & (1u << k)))
+                continue;
+            long long left = last_seen[k] + INPUT_HOLD_MS - now;
+            if (left < 0) left = 0;
+            if (timeout < 0 || left < timeout) timeout = left;
+        }
+
+        struct pollfd fds[2] = {
+            { .fd = STDIN_FILENO, .events = POLLIN },
+            { .fd = in->wake[0], .events = POLLIN },
+        };
+        if (poll(fds, 2, timeout) < 0)
+            continue;
+        if (fds[1].revents)
+            break;
+
+        now = now_ms();
+        if (fds[0].revents & POLLIN) {
+            u8 buf[64];
+            ssize_t got = read(STDIN_FILENO, buf, sizeof(buf));
+            // End of file comes back as readable too (POLLIN|POLLHUP with nothing to read), and would spin here forever
+            if (got == 0 || (got < 0 && errno != EINTR && errno != EAGAIN)) {
+                input_push(in, INPUT_QUIT, 0);
+                break;
+            }
+            for (ssize_t b = 0; b < got; b++) {
+                int key = input_map(buf[b]);
+                if (key < 0) {
+                    input_push(in, INPUT_QUIT, 0);
+                    continue;
+                }
+                if (!(held & (1u << key)))
+                    input_push(in, INPUT_PRESS, key);
+                held |= 1u << key;
+                last_seen[key] = now;
+            }
+        }
+        else if (fds[0].revents & (POLLHUP | POLLERR)) {
+            input_push(in, INPUT_QUIT, 0);
+            break;
+        }
+
+        // Remove keys that haven't been seen for a while
+        for (int k = 0; k <= INPUT_REWIND; k++) {
+            if ((held & (1u << k)) && now - last_seen[k] >= INPUT_HOLD_MS) {
+                held &= ~(1u << k);
+                input_push(in, INPUT_RELEASE, k);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+bool input_start(struct input *in)
+{
+    atomic_init(&in->head, 0);
+    atomic_init(&in->tail, 0);
+    in->mask = 0;
+    in->release_next = 0;
+    in->quit = false;
+
+    if (pipe(in->wake) != 0)
+        return false;
+    if (pthread_create(&in->thread, NULL, input_thread, in) != 0) {
+        close(in->wake[0]);
+        close(in->wake[1]);
+        return false;
+    }
+    return true;
+}
+
+void input_stop(struct input *in)
+{
+    u8 byte = 0;
+    if (write(in->wake[1], &byte, 1) == 1)
+        pthread_join(in->thread, NULL);
+    close(in->wake[0]);
+    close(in->wake[1]);
+}
+
+u16 input_key_mask(struct input *in)
+{
+    // Releases held back last time so their press could be seen
+    in->mask &= ~in->release_next;
+    in->release_next = 0;
+
+    u32 pressed_now = 0;
+    u32 tail = atomic_load_explicit(&in->tail, memory_order_relaxed);
+    u32 head = atomic_load_explicit(&in->head, memory_order_acquire);
+    for (; tail != head; tail++) {
+        struct input_event e = in->ring[tail & (INPUT_RING - 1)];
+        switch (e.type) {
+            case INPUT_PRESS:
+                in->mask |= 1u << e.key;
+                pressed_now |= 1u << e.key;
+                in->release_next &= ~(1u << e.key);
+                break;
+            case INPUT_RELEASE:
+                if (pressed_now & (1u << e.key))
+                    in->release_next |= 1u << e.key;
+                else
+                    in->mask &= ~(1u << e.key);
+                break;
+            case INPUT_QUIT:
+                in->quit = true;
+                break;
+        }
+    }
+    atomic_store_explicit(&in->tail, tail, memory_order_release);
+
+    return in->mask & 0xFFFF;
+}
+
+bool input_rewinding(const struct input *in)
+{
+    return in->mask & (1u << INPUT_REWIND);
+}
+
+bool input_quit(const struct input *in)
+{
+    return in->quit;
+}
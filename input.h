@@ -0,0 +1,49 @@
+#pragma once
+#include "chip8.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define INPUT_RING 256    // Power of two
+#define INPUT_HOLD_MS 40  // Terminals don't report releases, a key counts as held this long after its last byte
+#define INPUT_REWIND 16   // Pseudo key index for the rewind key, past the 16 keypad keys
+
+enum input_event_type {
+    INPUT_PRESS,
+    INPUT_RELEASE,
+    INPUT_QUIT,
+};
+
+struct input_event {
+    u8 type;
+    u8 key; // 0x0-0xF keypad, INPUT_REWIND for backspace
+};
+
+// Keyboard input on its own thread: it blocks in poll() on stdin, turns bytes into press/release events and pushes
+// them into a single-producer/single-consumer ring, so the emulation loop never makes a syscall for input
+struct input {
+    pthread_t thread;
+    int wake[2]; // Writing to wake[1] stops the thread
+
+    struct input_event ring[INPUT_RING];
+    _Atomic u32 head; // Written by the input thread only
+    _Atomic u32 tail; // Written by the consumer only
+
+    // Consumer side, see input_key_mask
+    u32 mask;
+    u32 release_next;
+    bool quit;
+};
+
+// Start the input thread on stdin. The terminal should already be in raw mode
+bool input_start(struct input *in);
+void input_stop(struct input *in);
+
+// Drain pending events and return the keypad mask for this frame. A key pressed and released between two calls
+// still shows up as held for one call, so short taps aren't lost at low frame rates
+u16 input_key_mask(struct input *in);
+
+// Whether the rewind key is held, as of the last input_key_mask
+bool input_rewinding(const struct input *in);
+
+// Whether a quit key was pressed, as of the last input_key_mask
+bool input_quit(const struct input *in);
@@ -0,0 +1,521 @@
+#include "lanes.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Comparisons give signed lanes of the same width, converting those sign-extends a mask to any other width
+typedef signed char lane_s8 __attribute__((vector_size(LANE_W)));
+typedef short lane_s16 __attribute__((vector_size(LANE_W * 2)));
+typedef int lane_s32 __attribute__((vector_size(LANE_W * 4)));
+typedef long long lane_s64 __attribute__((vector_size(LANE_W * 8)));
+
+#define MASK16(m) ((lane_u16)__builtin_convertvector((lane_s8)(m), lane_s16))
+#define MASK32(m) ((lane_u32)__builtin_convertvector((lane_s8)(m), lane_s32))
+#define MASK64(m) ((lane_u64)__builtin_convertvector((lane_s8)(m), lane_s64))
+#define NARROW16(m) ((lane_u8)__builtin_convertvector((lane_s16)(m), lane_s8))
+#define NARROW64(m) ((lane_u8)__builtin_convertvector((lane_s64)(m), lane_s8))
+#define WIDEN16(v) __builtin_convertvector((v), lane_u16)
+
+// a where the mask is set, b elsewhere
+#define BLEND(m, a, b) (((a) & (m)) | ((b) & ~(m)))
+
+static inline bool lanes_any(const void *mask, size_t size)
+{
+    u64 any = 0;
+    for (size_t k = 0; k < size; k += 8) {
+        u64 word;
+        memcpy(&word, (const u8 *)mask + k, 8);
+        any |= word;
+    }
+    return any != 0;
+}
+
+static void *lanes_alloc(size_t size)
+{
+    size = (size + 127) & ~(size_t)127; // aligned_alloc wants a multiple of the alignment
+    void *p = aligned_alloc(128, size);
+    if (p)
+        memset(p, 0, size);
+    return p;
+}
+
+void lanes_free(struct chip_lanes *L)
+{
+    if (!L)
+        return;
+    free(L->v);
+    free(L->pc);
+    free(L->i);
+    free(L->sp);
+    free(L->stack);
+    free(L->delay);
+    free(L->sound);
+    free(L->rng);
+    free(L->display);
+    free(L->mem);
+    free(L->left);
+    free(L->keys);
+    free(L->active);
+    free(L);
+}
+
+struct chip_lanes *lanes_new(u32 count, enum chip_quirks quirks)
+{
+    if (quirks != QUIRKS_DEFAULT && quirks != QUIRKS_CHIP8) {
+        errno = EINVAL;
+        return NULL;
+    }
+    struct chip_lanes *L = calloc(1, sizeof(*L));
+    if (!L)
+        return NULL;
+    L->count = count;
+    L->packs = (count + LANE_W - 1) / LANE_W;
+    L->quirks = quirks;
+
+    u32 p = L->packs;
+    L->v = lanes_alloc(16 * p * sizeof(lane_u8));
+    L->pc = lanes_alloc(p * sizeof(lane_u16));
+    L->i = lanes_alloc(p * sizeof(lane_u16));
+    L->sp = lanes_alloc(p * sizeof(lane_u8));
+    L->stack = lanes_alloc(LANE_STACK * p * sizeof(lane_u16));
+    L->delay = lanes_alloc(p * sizeof(lane_u8));
+    L->sound = lanes_alloc(p * sizeof(lane_u8));
+    L->rng = lanes_alloc(p * sizeof(lane_u32));
+    L->display = lanes_alloc(DISPLAY_H * p * sizeof(lane_u64));
+    L->mem = lanes_alloc((size_t)p * LANE_W * 0x1000);
+    L->left = lanes_alloc(p * sizeof(lane_u16));
+    L->keys = lanes_alloc(p * sizeof(lane_u16));
+    L->active = lanes_alloc(p * sizeof(lane_u16));
+    if (!L->v || !L->pc || !L->i || !L->sp || !L->stack || !L->delay || !L->sound || !L->rng || !L->display ||
+        !L->mem || !L->left || !L->keys || !L->active) {
+        lanes_free(L);
+        return NULL;
+    }
+    return L;
+}
+
+enum chip_error lanes_load_rom(struct chip_lanes *L, const struct chip_rom *rom)
+{
+    if (rom->size > 0x1000 - 0x200)
+        return CHIP_ERR_TOO_BIG;
+
+    // Build one machine the normal way, then clone it into every lane
+    u8 image[0x1000];
+    memset(image, 0, sizeof(image));
+    memcpy(&image[font_addr], font, 80);
+    memcpy(&image[font_big_addr], font_big, 160);
+    if (rom->size)
+        memcpy(&image[0x200], rom->data, rom->size);
+
+    u32 stride = L->packs * LANE_W;
+    for (u32 l = 0; l < stride; l++)
+        memcpy(&L->mem[(size_t)l * 0x1000], image, sizeof(image));
+    memset(L->written, 0, sizeof(L->written));
+
+    memset(L->v, 0, 16 * stride);
+    memset(L->i, 0, stride * sizeof(u16));
+    memset(L->sp, 0, stride);
+    memset(L->stack, 0, LANE_STACK * stride * sizeof(u16));
+    memset(L->delay, 0, stride);
+    memset(L->sound, 0, stride);
+    memset(L->display, 0, DISPLAY_H * stride * sizeof(u64));
+    u16 *pc = (u16 *)L->pc;
+    for (u32 l = 0; l < stride; l++) {
+        pc[l] = 0x200;
+        lanes_seed(L, l, l + 1);
+    }
+    L->steps = 0;
+    L->insns = 0;
+    return CHIP_OK;
+}
+
+void lanes_seed(struct chip_lanes *L, u32 lane, u32 seed)
+{
+    ((u32 *)L->rng)[lane] = seed ? seed : 1;
+}
+
+void lanes_tick(struct chip_lanes *L)
+{
+    for (u32 p = 0; p < L->packs; p++) {
+        L->delay[p] -= (lane_u8)(L->delay[p] != 0) & 1;
+        L->sound[p] -= (lane_u8)(L->sound[p] != 0) & 1;
+    }
+}
+
+// DXYN for one lane, exactly chip_draw on the lo-res display
+static u8 lane_draw(struct chip_lanes *L, u32 l, u8 vx, u8 vy, u8 n, u16 addr, bool clip)
+{
+    const u8 *mem = &L->mem[(size_t)l * 0x1000];
+    u64 *display = (u64 *)L->display;
+    u32 stride = L->packs * LANE_W;
+    u8 sx = vx % DISPLAY_W, sy = vy % DISPLAY_H;
+    int rows = sy + n > DISPLAY_H ? DISPLAY_H - sy : n;
+
+    u64 hit = 0;
+    for (int r = 0; r < rows; r++) {
+        u64 sprite = (u64)mem[(addr + r) & 0xFFF] << 56;
+        u64 mask = clip ? sprite >> sx : sx ? (sprite >> sx) | (sprite << (64 - sx)) : sprite;
+        u64 *row = &display[(sy + r) * stride + l];
+        hit |= *row & mask;
+        *row ^= mask;
+    }
+    return hit != 0;
+}
+
+// Every lane set in m, as a lane number
+#define FOR_ACTIVE(l) \
+    for (u32 k_ = 0, l = p * LANE_W; k_ < LANE_W; k_++, l++) \
+        if (m[k_])
+
+// Conditional skips, one vector add for however many lanes took them
+#define SKIP_IF(c) (L->pc[p] += MASK16(m & (lane_u8)(c)) & 2)
+
+#define LANES_DONE 0x10000
+
+// The lowest pc any lane with instructions left is at, LANES_DONE once they're all done. FX0A can back pc up to 0xFFFF,
+// so that isn't free to mean "done"
+static u32 lanes_target(const lane_u16 *best, const lane_u16 *running)
+{
+    if (!lanes_any(running, sizeof(*running)))
+        return LANES_DONE;
+    u32 target = 0xFFFF;
+    for (int k = 0; k < LANE_W; k++)
+        if ((*best)[k] < target)
+            target = (*best)[k];
+    return target;
+}
+
+// Fetch from memory some lane has stored to. Only the lanes holding the same word as the first one at `target` take
+// part, L->active gets their masks
+static u16 lanes_fetch_split(struct chip_lanes *L, u16 target)
+{
+    u16 addr = target & 0xFFF, addr1 = (target + 1) & 0xFFF;
+    u16 instruction = 0;
+    bool first = true;
+    for (u32 p = 0; p < L->packs; p++) {
+        L->active[p] = (lane_u16)(L->pc[p] == target) & (lane_u16)(L->left[p] != 0);
+        for (u32 k = 0, l = p * LANE_W; k < LANE_W; k++, l++) {
+            if (!L->active[p][k])
+                continue;
+            const u8 *mem = &L->mem[(size_t)l * 0x1000];
+            u16 word = (mem[addr] << 8) | mem[addr1];
+            if (first) {
+                instruction = word;
+                first = false;
+            }
+            else if (word != instruction) {
+                L->active[p][k] = 0;
+            }
+        }
+    }
+    return instruction;
+}
+
+void lanes_run(struct chip_lanes *L, const u16 *key_masks, u32 cycles)
+{
+    // left is 16 bits wide to match pc, so longer runs go in chunks
+    while (cycles > 0xFFFF) {
+        lanes_run(L, key_masks, 0xFFFF);
+        cycles -= 0xFFFF;
+    }
+
+    u32 packs = L->packs, stride = packs * LANE_W;
+    u8 *v8 = (u8 *)L->v;
+    u16 *pc16 = (u16 *)L->pc, *i16 = (u16 *)L->i, *stack16 = (u16 *)L->stack, *keys16 = (u16 *)L->keys;
+    u8 *sp8 = (u8 *)L->sp;
+    bool clip = L->quirks == QUIRKS_CHIP8;
+    bool logic_vf = L->quirks == QUIRKS_CHIP8;
+    bool load_store_inc = L->quirks == QUIRKS_CHIP8;
+    bool addi_carry = L->quirks == QUIRKS_DEFAULT;
+
+    lane_u16 best = (lane_u16){ 0 } - 1, running = { 0 };
+    for (u32 p = 0; p < packs; p++) {
+        for (u32 k = 0, l = p * LANE_W; k < LANE_W; k++, l++) {
+            L->left[p][k] = l < L->count ? cycles : 0;
+            keys16[l] = l < L->count && key_masks ? key_masks[l] : 0;
+        }
+        lane_u16 run = (lane_u16)(L->left[p] != 0);
+        lane_u16 cand = L->pc[p] | ~run;
+        best = BLEND((lane_u16)(cand < best), cand, best);
+        running |= run;
+    }
+
+    #define V(r) L->v[(r) * packs + p]
+
+    for (u32 t = lanes_target(&best, &running); t != LANES_DONE; t = lanes_target(&best, &running)) {
+        u16 target = t;
+        // Code nobody wrote to is the same in every lane, so one fetch does for everyone
+        u16 addr = target & 0xFFF, addr1 = (target + 1) & 0xFFF;
+        bool split = L->written[addr] || L->written[addr1];
+        u16 instruction = split ? lanes_fetch_split(L, target) : (L->mem[addr] << 8) | L->mem[addr1];
+
+        u8 x = (instruction >> 8) & 0x0F;
+        u8 y = (instruction >> 4) & 0x0F;
+        u8 n = instruction & 0x000F;
+        u8 nn = instruction & 0x00FF;
+        u16 nnn = instruction & 0x0FFF;
+        u16 next = (addr + 2) & 0xFFF;
+
+        // One pass: pick out the lanes on target, run the instruction on them, and find the next target as we go
+        best = (lane_u16){ 0 } - 1;
+        running = (lane_u16){ 0 };
+        lane_u16 moved = { 0 };
+        for (u32 p = 0; p < packs; p++) {
+            lane_u16 m16 = split ? L->active[p] : (lane_u16)(L->pc[p] == target) & (lane_u16)(L->left[p] != 0);
+            if (lanes_any(&m16, sizeof(m16))) {
+                lane_u8 m = NARROW16(m16);
+                L->left[p] -= m16 & 1;
+                moved += m16 & 1;
+                L->pc[p] = BLEND(m16, (lane_u16){ 0 } + next, L->pc[p]);
+
+                switch (instruction >> 12) {
+                    case 0x0:
+                        if (instruction == 0x00E0) {
+                            lane_u64 keep = ~MASK64(m);
+                            for (int r = 0; r < DISPLAY_H; r++)
+                                L->display[r * packs + p] &= keep;
+                        }
+                        else if (instruction == 0x00EE) {
+                            FOR_ACTIVE(l) {
+                                sp8[l]--;
+                                pc16[l] = stack16[(sp8[l] % LANE_STACK) * stride + l];
+                            }
+                        }
+                        break;
+                    case 0x1:
+                        L->pc[p] = BLEND(m16, (lane_u16){ 0 } + nnn, L->pc[p]);
+                        break;
+                    case 0x2:
+                        FOR_ACTIVE(l) {
+                            stack16[(sp8[l] % LANE_STACK) * stride + l] = pc16[l];
+                            sp8[l]++;
+                        }
+                        L->pc[p] = BLEND(m16, (lane_u16){ 0 } + nnn, L->pc[p]);
+                        break;
+                    case 0x3:
+                        SKIP_IF(V(x) == nn);
+                        break;
+                    case 0x4:
+                        SKIP_IF(V(x) != nn);
+                        break;
+                    case 0x5:
+                        SKIP_IF(V(x) == V(y));
+                        break;
+                    case 0x6:
+                        V(x) = BLEND(m, (lane_u8){ 0 } + nn, V(x));
+                        break;
+                    case 0x7:
+                        V(x) = BLEND(m, V(x) + nn, V(x));
+                        break;
+                    case 0x8: {
+                        // Same order of reads and writes as chip_cycle, so x or y being F comes out the same
+                        lane_u8 flag;
+                        switch (n) {
+                            case 0x0:
+                                V(x) = BLEND(m, V(y), V(x));
+                                break;
+                            case 0x1:
+                                V(x) = BLEND(m, V(x) | V(y), V(x));
+                                if (logic_vf)
+                                    V(0xF) &= ~m;
+                                break;
+                            case 0x2:
+                                V(x) = BLEND(m, V(x) & V(y), V(x));
+                                if (logic_vf)
+                                    V(0xF) &= ~m;
+                                break;
+                            case 0x3:
+                                V(x) = BLEND(m, V(x) ^ V(y), V(x));
+                                if (logic_vf)
+                                    V(0xF) &= ~m;
+                                break;
+                            case 0x4:
+                                V(x) = BLEND(m, V(x) + V(y), V(x));
+                                V(0xF) = BLEND(m, (lane_u8)(V(x) < V(y)) & 1, V(0xF));
+                                break;
+                            case 0x5:
+                                flag = (lane_u8)(V(x) >= V(y)) & 1;
+                                V(x) = BLEND(m, V(x) - V(y), V(x));
+                                V(0xF) = BLEND(m, flag, V(0xF));
+                                break;
+                            case 0x6:
+                                V(x) = BLEND(m, V(y), V(x));
+                                flag = V(x) & 1;
+                                V(x) = BLEND(m, V(x) >> 1, V(x));
+                                V(0xF) = BLEND(m, flag, V(0xF));
+                                break;
+                            case 0x7:
+                                flag = (lane_u8)(V(y) >= V(x)) & 1;
+                                V(x) = BLEND(m, V(y) - V(x), V(x));
+                                V(0xF) = BLEND(m, flag, V(0xF));
+                                break;
+                            case 0xE:
+                                V(x) = BLEND(m, V(y), V(x));
+                                flag = V(x) >> 7;
+                                V(x) = BLEND(m, V(x) << 1, V(x));
+                                V(0xF) = BLEND(m, flag, V(0xF));
+                                break;
+                        }
+                        break;
+                    }
+                    case 0x9:
+                        SKIP_IF(V(x) != V(y));
+                        break;
+                    case 0xA:
+                        L->i[p] = BLEND(m16, (lane_u16){ 0 } + nnn, L->i[p]);
+                        break;
+                    case 0xB:
+                        L->pc[p] = BLEND(m16, (WIDEN16(V(0)) + nnn) & 0xFFF, L->pc[p]);
+                        break;
+                    case 0xC: {
+                        lane_u32 r = L->rng[p];
+                        r ^= r << 13;
+                        r ^= r >> 17;
+                        r ^= r << 5;
+                        L->rng[p] = BLEND(MASK32(m), r, L->rng[p]);
+                        V(x) = BLEND(m, __builtin_convertvector(r >> 24, lane_u8) & nn, V(x));
+                        break;
+                    }
+                    case 0xD: {
+                        // Every lane drawing the same sprite at the same place is one masked XOR per row for the
+                        // whole pack. Anything else is drawn lane by lane
+                        int k0 = 0;
+                        while (!m[k0])
+                            k0++;
+                        u8 vx = V(x)[k0], vy = V(y)[k0];
+                        u16 i = L->i[p][k0];
+                        lane_u8 same = (lane_u8)(V(x) == vx) & (lane_u8)(V(y) == vy) & NARROW16(L->i[p] == i);
+                        bool shared = true;
+                        for (int r = 0; r < n && shared; r++)
+                            shared = !L->written[(i + r) & 0xFFF];
+                        lane_u8 odd = m & ~same;
+                        if (shared && !lanes_any(&odd, sizeof(odd))) {
+                            const u8 *mem = &L->mem[(size_t)(p * LANE_W + k0) * 0x1000];
+                            u8 sx = vx % DISPLAY_W, sy = vy % DISPLAY_H;
+                            int rows = sy + n > DISPLAY_H ? DISPLAY_H - sy : n;
+                            lane_u64 m64 = MASK64(m), hit = { 0 };
+                            for (int r = 0; r < rows; r++) {
+                                u64 sprite = (u64)mem[(i + r) & 0xFFF] << 56;
+                                u64 row = clip ? sprite >> sx : sx ? (sprite >> sx) | (sprite << (64 - sx)) : sprite;
+                                lane_u64 mask = m64 & row;
+                                hit |= L->display[(sy + r) * packs + p] & mask;
+                                L->display[(sy + r) * packs + p] ^= mask;
+                            }
+                            V(0xF) = BLEND(m, NARROW64(hit != 0) & 1, V(0xF));
+                        }
+                        else {
+                            FOR_ACTIVE(l)
+                                v8[0xF * stride + l] = lane_draw(L, l, v8[x * stride + l], v8[y * stride + l], n,
+                                                                 i16[l], clip);
+                        }
+                        break;
+                    }
+                    case 0xE: {
+                        lane_u16 vx = WIDEN16(V(x));
+                        lane_u16 pressed = (L->keys[p] >> (vx & 15)) & 1 & (lane_u16)(vx < 16);
+                        if (nn == 0x9E)
+                            SKIP_IF(NARROW16(pressed != 0));
+                        else if (nn == 0xA1)
+                            SKIP_IF(NARROW16(pressed == 0));
+                        break;
+                    }
+                    case 0xF:
+                        switch (nn) {
+                            case 0x07:
+                                V(x) = BLEND(m, L->delay[p], V(x));
+                                break;
+                            case 0x15:
+                                L->delay[p] = BLEND(m, V(x), L->delay[p]);
+                                break;
+                            case 0x18:
+                                L->sound[p] = BLEND(m, V(x), L->sound[p]);
+                                break;
+                            case 0x1E: {
+                                lane_u16 sum = L->i[p] + WIDEN16(V(x));
+                                if (addi_carry)
+                                    V(0xF) = BLEND(m, NARROW16(sum > 0x0FFF) & 1, V(0xF));
+                                L->i[p] = BLEND(m16, sum & 0x0FFF, L->i[p]);
+                                break;
+                            }
+                            case 0x0A:
+                                FOR_ACTIVE(l) {
+                                    if (keys16[l] == 0)
+                                        pc16[l] -= 2;
+                                    else
+                                        v8[x * stride + l] = __builtin_ctz(keys16[l]);
+                                }
+                                break;
+                            case 0x29:
+                                L->i[p] = BLEND(m16, WIDEN16(V(x)) * 5 + font_addr, L->i[p]);
+                                break;
+                            case 0x33:
+                                FOR_ACTIVE(l) {
+                                    u8 *mem = &L->mem[(size_t)l * 0x1000];
+                                    u8 vx = v8[x * stride + l];
+                                    u16 i = i16[l];
+                                    mem[i & 0xFFF] = vx / 100;
+                                    mem[(i + 1) & 0xFFF] = (vx / 10) % 10;
+                                    mem[(i + 2) & 0xFFF] = vx % 10;
+                                    for (int k = 0; k < 3; k++)
+                                        L->written[(i + k) & 0xFFF] = 1;
+                                }
+                                break;
+                            case 0x55:
+                                FOR_ACTIVE(l) {
+                                    u8 *mem = &L->mem[(size_t)l * 0x1000];
+                                    for (int k = 0; k <= x; k++) {
+                                        mem[(i16[l] + k) & 0xFFF] = v8[k * stride + l];
+                                        L->written[(i16[l] + k) & 0xFFF] = 1;
+                                    }
+                                    if (load_store_inc)
+                                        i16[l] = (i16[l] + x + 1) & 0xFFF;
+                                }
+                                break;
+                            case 0x65:
+                                FOR_ACTIVE(l) {
+                                    const u8 *mem = &L->mem[(size_t)l * 0x1000];
+                                    for (int k = 0; k <= x; k++)
+                                        v8[k * stride + l] = mem[(i16[l] + k) & 0xFFF];
+                                    if (load_store_inc)
+                                        i16[l] = (i16[l] + x + 1) & 0xFFF;
+                                }
+                                break;
+                        }
+                        break;
+                }
+            }
+
+            lane_u16 run = (lane_u16)(L->left[p] != 0);
+            lane_u16 cand = L->pc[p] | ~run;
+            best = BLEND((lane_u16)(cand < best), cand, best);
+            running |= run;
+        }
+
+        u32 count = 0;
+        for (int k = 0; k < LANE_W; k++)
+            count += moved[k];
+        L->insns += count;
+        L->steps++;
+    }
+
+    #undef V
+}
+
+void lanes_get(const struct chip_lanes *L, u32 lane, struct chip8 *chip)
+{
+    u32 stride = L->packs * LANE_W;
+    for (int r = 0; r < 16; r++)
+        chip->v[r] = ((const u8 *)L->v)[r * stride + lane];
+    chip->pc = ((const u16 *)L->pc)[lane];
+    chip->i = ((const u16 *)L->i)[lane];
+    chip->sp = ((const u8 *)L->sp)[lane];
+    for (int d = 0; d < 48; d++)
+        chip->stack[d] = ((const u16 *)L->stack)[d * stride + lane];
+    chip->delay = ((const u8 *)L->delay)[lane];
+    chip->sound = ((const u8 *)L->sound)[lane];
+    chip->rng = ((const u32 *)L->rng)[lane];
+    chip_mem_write(chip, 0, &L->mem[(size_t)lane * 0x1000], 0x1000);
+    for (int r = 0; r < DISPLAY_H; r++)
+        chip->display[r] = ((const u64 *)L->display)[r * stride + lane];
+    chip->dirty = DISPLAY_ALL_ROWS;
+}
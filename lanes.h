@@ -0,0 +1,66 @@
+#pragma once
+#include "chip8.h"
+
+// Lockstep batch interpreter: many copies of one ROM stored structure-of-arrays, so each instruction runs for every
+// lane sitting on it at once with vector ops. Each step executes the lowest pc any unfinished lane is at, masking out
+// lanes that are somewhere else. Lanes that branched off wait there and fall back in step when the others catch up,
+// which in practice is the next trip round the main loop. Behaves exactly like a chip_run per lane with deltatime 0.
+// Lo-res classic programs only: QUIRKS_DEFAULT and QUIRKS_CHIP8
+
+#define LANE_W 8 // Lanes per vector. 8 u16 pcs fill one SSE register, and GCC splits anything wider into scalar compares
+
+typedef u8  lane_u8  __attribute__((vector_size(LANE_W)));
+typedef u16 lane_u16 __attribute__((vector_size(LANE_W * 2)));
+typedef u32 lane_u32 __attribute__((vector_size(LANE_W * 4)));
+typedef u64 lane_u64 __attribute__((vector_size(LANE_W * 8)));
+
+#define LANE_STACK 64 // Stack depth per lane, indexes wrap instead of running off the end
+
+struct chip_lanes {
+    u32 count;  // Lanes in use
+    u32 packs;  // Vectors per array, count rounded up to LANE_W. The padding lanes never run
+    enum chip_quirks quirks;
+
+    // Element k of pack p is lane p*LANE_W + k. Indexed arrays are [index * packs + p], so v[3] of every lane is
+    // v[3 * packs] to v[3 * packs + packs - 1]
+    lane_u8 *v;
+    lane_u16 *pc;
+    lane_u16 *i;
+    lane_u8 *sp;
+    lane_u16 *stack;   // [depth * packs + p]
+    lane_u8 *delay;
+    lane_u8 *sound;
+    lane_u32 *rng;
+    lane_u64 *display; // [row * packs + p], the 32 lo-res rows
+    u8 *mem;           // Lane l's 4KB starts at mem[l * 0x1000]
+
+    // Scratch for lanes_run
+    lane_u16 *left;    // Instructions each lane still has to run
+    lane_u16 *keys;
+    lane_u16 *active;  // Lanes taking part in a step that fetched from written memory
+
+    u8 written[0x1000]; // Nonzero where any lane has stored to memory. Everywhere else all lanes still hold the ROM,
+                        // so code there can be fetched once for everyone
+
+    u64 steps; // Lockstep dispatches so far
+    u64 insns; // Instructions run summed over lanes. insns / steps is how many lanes moved together on average
+};
+
+// Allocate `count` lanes. Returns NULL if out of memory, or with errno EINVAL for a profile it can't run
+struct chip_lanes *lanes_new(u32 count, enum chip_quirks quirks);
+void lanes_free(struct chip_lanes *lanes);
+
+// Reset every lane to a freshly loaded machine running `rom`. CXNN seeds are set to the lane number + 1
+enum chip_error lanes_load_rom(struct chip_lanes *lanes, const struct chip_rom *rom);
+
+// Give one lane its own CXNN sequence
+void lanes_seed(struct chip_lanes *lanes, u32 lane, u32 seed);
+
+// Run `cycles` instructions on every lane, lane l seeing key_masks[l] (NULL for no keys at all)
+void lanes_run(struct chip_lanes *lanes, const u16 *key_masks, u32 cycles);
+
+// One 60Hz timer tick on every lane
+void lanes_tick(struct chip_lanes *lanes);
+
+// Copy one lane out into a machine set up with chip_init and the same profile
+void lanes_get(const struct chip_lanes *lanes, u32 lane, struct chip8 *chip);
@@ -1,9 +1,19 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
 #include "chip8.h"
 #include "ui.h"
+#include "audio.h"
+#include "batch.h"
+#include "sched.h"
+#include "profile.h"
+#include "movie.h"
+#include "trace.h"
+#include "export.h"
+#include "publish.h"
 
 u16 get_width() {
 	struct winsize w;
@@ -13,38 +23,21 @@ u16 get_width() {
 	return w.ws_col;
 }
 
-int main(int argc, char **argv)
+// Debug mode: run a fixed number of instructions, printing every frame that changed. Add -T for what ran in between
+static void run_iterations(struct chip8 *chip, int iterations)
 {
-    if (argc < 2) {
-        printf("Usage: ./chip8 PROGRAM [iterations]\n\tPROGRAM\tPath to a .ch8 program to be run\n\n\titerations\tNumber of iterations to run the program");
-        return 1;
-    }
+    int columns = get_width();
 
-    struct chip8 chip;
-    chip_init(&chip);
-    chip_load(&chip, argv[1]);
-    chip.debug = true;
-
-    // No iterations means do the REAL THING
-    if (argc < 3) {
-        gui_main(&chip);
-        return 0;
-    }
-
-    int iterations = atoi(argv[2]);
-    int width = get_width();
-    if (width > DISPLAY_W)
-    	width = DISPLAY_W;
-
-    for (int i = 0; i < iterations; i++) {
-        printf("%d: ", i+1);
-        if (!chip_cycle(&chip, 0, 0))
+    for (int i = 0; i < iterations && !chip->halted; i++) {
+        if (!chip_cycle(chip, 0, 0))
             continue;
+        printf("%d:\n", i+1);
         //printf("\e[1;1H\e[2J");
-        for (int y = 0; y < DISPLAY_H; y+=2) {
-            for (int x = 0; x < DISPLAY_W; x++) {
-                bool top = DISPLAY_GET(chip.display, x, y);
-                bool bottom = DISPLAY_GET(chip.display, x, y+1);
+        int width = CHIP_W(chip) < columns ? CHIP_W(chip) : columns;
+        for (int y = 0; y < CHIP_H(chip); y+=2) {
+            for (int x = 0; x < width; x++) {
+                bool top = CHIP_GET(chip, x, y);
+                bool bottom = CHIP_GET(chip, x, y+1);
                 if (top && bottom)
                     printf("\u2588");
                 else if (top && !bottom)
@@ -57,6 +50,258 @@ int main(int argc, char **argv)
             printf("\n");
         }
     }
+}
+
+// Export mode: run `iterations` instructions in 60Hz frames like the GUI would, writing out every frame that changed
+static bool run_export(struct chip8 *chip, struct frame_export *e, u64 iterations, u32 ipf)
+{
+    struct sched sched;
+    sched_init(&sched, ipf, true);
+    export_frame(e, chip, 0);
+    chip->dirty = 0;
+    for (u64 done = 0; done < iterations && !chip->halted; done += sched.ipf) {
+        sched_frame(&sched, chip, 0);
+        if (chip->dirty) {
+            chip->dirty = 0;
+            if (!export_frame(e, chip, sched.frame))
+                return false;
+        }
+    }
+    fprintf(stderr, "%llu frames written, %llu duplicates skipped\n",
+            (unsigned long long)e->written, (unsigned long long)e->duplicates);
+    return true;
+}
+
+// -q argument to a quirk profile, QUIRKS_COUNT if it isn't one
+static enum chip_quirks parse_quirks(const char *name)
+{
+    static const char *const names[QUIRKS_COUNT] = {
+        [QUIRKS_DEFAULT] = "default",
+        [QUIRKS_CHIP8] = "chip8",
+        [QUIRKS_SCHIP] = "schip",
+        [QUIRKS_XO] = "xochip",
+    };
+    for (int q = 0; q < QUIRKS_COUNT; q++)
+        if (strcmp(name, names[q]) == 0)
+            return q;
+    return QUIRKS_COUNT;
+}
+
+#ifdef CHIP_PROFILER
+static void write_profile(const struct chip_profile *profile, const char *path)
+{
+    char folded[1024];
+    snprintf(folded, sizeof(folded), "%s.folded", path);
+
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror(path);
+        return;
+    }
+    profile_report(profile, f);
+    fclose(f);
+
+    f = fopen(folded, "w");
+    if (!f) {
+        perror(folded);
+        return;
+    }
+    profile_folded(profile, f);
+    fclose(f);
+}
+#endif
+
+static void usage(void)
+{
+    printf("Usage: ./chip8 [-q QUIRKS] [-T FILE] [-x FILE | -X DIR] [-s IPF] PROGRAM [iterations]\n"
+           "       ./chip8 [-q QUIRKS] [-s IPF] [-t] [-w KB] [-a AUDIO] [-R MOVIE] [-S NAME] [-T FILE] [-I] [-M FILE] PROGRAM\n"
+           "       ./chip8 -b CYCLES [-j WORKERS] [-r] [-q QUIRKS] [-s IPF] PROGRAM[@MOVIE]...\n"
+           "       ./chip8 -m MOVIE [-r] PROGRAM\n"
+           "\tPROGRAM\tPath to a .ch8 program to be run\n\n"
+           "\titerations\tNumber of iterations to run the program\n"
+           "\t-q QUIRKS\tInterpreter quirks: default, chip8 (COSMAC VIP), schip (SUPER-CHIP) or xochip (XO-CHIP)\n"
+           "\t-s IPF\t\tInstructions per 60Hz frame (default: %d)\n"
+           "\t-t\t\tTurbo, run as fast as possible instead of at 60 frames/sec\n"
+           "\t-w KB\t\tRewind history size, hold backspace to rewind (default: 512, 0 disables)\n"
+           "\t-a AUDIO\tSound output: alsa, null or a .wav file to write (default: alsa)\n"
+           "\t-R MOVIE\tRecord the session's input to MOVIE\n"
+           "\t-x FILE\t\tWith iterations, write changed frames to FILE (- for stdout) as a raw 1-bit stream\n"
+           "\t-X DIR\t\tWith iterations, write changed frames into DIR as numbered .pbm files\n"
+           "\t-S NAME\t\tPublish frames to the shared memory segment NAME (eg /chip8), watch with chip8-view\n"
+           "\t-T FILE\t\tTrace every instruction to FILE, read it with chip8-trace\n"
+           "\t-I\t\tShow speed, frame times and key latency under the display\n"
+           "\t-M FILE\t\tWrite the same as key=value lines to FILE (- for stderr) once a second\n"
+           "\t-m MOVIE\tReplay MOVIE headless as fast as possible and check the final display against the recording\n"
+           "\t-b CYCLES\tHeadless batch mode, run every PROGRAM for CYCLES instructions, with MOVIE's keys if given\n"
+           "\t-j WORKERS\tNumber of batch worker threads (default: one per core)\n"
+           "\t-r\t\tUse the reference switch interpreter instead of the pre-decoded one\n"
+#ifdef CHIP_PROFILER
+           "\t-p FILE\t\tProfile the run, writing a report to FILE and collapsed stacks to FILE.folded\n"
+#endif
+           ,
+           SCHED_DEFAULT_IPF);
+}
+
+int main(int argc, char **argv)
+{
+    u64 batch_cycles = 0;
+    int workers = 0;
+    bool reference = false;
+    enum chip_quirks quirks = QUIRKS_DEFAULT;
+    const char *record_path = NULL, *replay_path = NULL, *trace_path = NULL, *export_path = NULL;
+    const char *publish_name = NULL, *metrics_path = NULL;
+    enum export_format export_format = EXPORT_RAW;
+#ifdef CHIP_PROFILER
+    const char *profile_path = NULL;
+#endif
+    struct gui_opts gui = { .ipf = SCHED_DEFAULT_IPF, .turbo = false, .rewind_kb = 512, .audio = "alsa" };
+
+    int opt;
+#ifdef CHIP_PROFILER
+    const char *optstring = "b:j:rq:s:tw:a:R:m:T:x:X:S:IM:p:h";
+#else
+    const char *optstring = "b:j:rq:s:tw:a:R:m:T:x:X:S:IM:h";
+#endif
+    while ((opt = getopt(argc, argv, optstring)) != -1) {
+        switch (opt) {
+            case 'b': batch_cycles = strtoull(optarg, NULL, 0); break;
+            case 'j': workers = atoi(optarg); break;
+            case 'r': reference = true; break;
+            case 'q':
+                quirks = parse_quirks(optarg);
+                if (quirks == QUIRKS_COUNT) {
+                    usage();
+                    return 1;
+                }
+                break;
+            case 's': gui.ipf = strtoul(optarg, NULL, 0); break;
+            case 't': gui.turbo = true; break;
+            case 'w': gui.rewind_kb = strtoul(optarg, NULL, 0); break;
+            case 'a':
+                if (!audio_spec_valid(optarg)) {
+                    usage();
+                    return 1;
+                }
+                gui.audio = optarg;
+                break;
+            case 'R': record_path = optarg; break;
+            case 'm': replay_path = optarg; break;
+            case 'T': trace_path = optarg; break;
+            case 'x': export_path = optarg; export_format = EXPORT_RAW; break;
+            case 'X': export_path = optarg; export_format = EXPORT_PBM; break;
+            case 'S': publish_name = optarg; break;
+            case 'I': gui.status = true; break;
+            case 'M': metrics_path = optarg; break;
+#ifdef CHIP_PROFILER
+            case 'p': profile_path = optarg; break;
+#endif
+            default: usage(); return 1;
+        }
+    }
+    argc -= optind - 1;
+    argv += optind - 1;
+
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+
+    if (batch_cycles > 0)
+        return batch_main((const char **)&argv[1], argc - 1, batch_cycles, gui.ipf, workers, reference, quirks);
+    if (replay_path)
+        return movie_replay_main(replay_path, argv[1], reference);
+
+    struct chip8 chip;
+    chip_init(&chip);
+    if (!chip_set_quirks(&chip, quirks)) {
+        perror("chip_set_quirks");
+        return 1;
+    }
+    enum chip_error err = chip_load(&chip, argv[1]);
+    if (err != CHIP_OK) {
+        fprintf(stderr, "%s: %s\n", argv[1], chip_strerror(err));
+        chip_deinit(&chip);
+        return 1;
+    }
+    if (trace_path && !trace_attach(&chip, trace_path)) {
+        perror(trace_path);
+        chip_deinit(&chip);
+        return 1;
+    }
+
+#ifdef CHIP_PROFILER
+    if (profile_path && !profile_attach(&chip)) {
+        perror("profile_attach");
+        trace_detach(&chip);
+        chip_deinit(&chip);
+        return 1;
+    }
+#endif
+
+    // No iterations means do the REAL THING
+    int status = 0;
+    struct chip_movie movie;
+    if (argc < 3) {
+        // stdout is the display, so - is stderr here
+        if (metrics_path) {
+            gui.metrics = strcmp(metrics_path, "-") == 0 ? stderr : fopen(metrics_path, "w");
+            if (!gui.metrics) {
+                perror(metrics_path);
+                chip_deinit(&chip);
+                return 1;
+            }
+        }
+        struct publisher publisher;
+        if (publish_name) {
+            if (!publish_open(&publisher, publish_name)) {
+                perror(publish_name);
+                if (gui.metrics && gui.metrics != stderr)
+                    fclose(gui.metrics);
+                chip_deinit(&chip);
+                return 1;
+            }
+            gui.publisher = &publisher;
+        }
+        // Keep the seed chip_init picked, the movie just has to remember it
+        if (record_path) {
+            movie_start(&movie, &chip, chip.rng, gui.ipf ? gui.ipf : SCHED_DEFAULT_IPF);
+            gui.movie = &movie;
+        }
+        gui_main(&chip, &gui);
+        if (record_path) {
+            movie_finish(&movie, &chip);
+            if (!movie_write(&movie, record_path))
+                perror(record_path);
+            movie_free(&movie);
+        }
+        if (publish_name)
+            publish_close(&publisher);
+        if (gui.metrics && gui.metrics != stderr && fclose(gui.metrics) != 0) {
+            perror(metrics_path);
+            status = 1;
+        }
+    }
+    else if (export_path) {
+        static struct frame_export export;
+        bool ok = export_open(&export, export_format, export_path) &&
+                  run_export(&chip, &export, strtoull(argv[2], NULL, 0), gui.ipf);
+        if (!export_close(&export) || !ok) {
+            perror(export_path);
+            status = 1;
+        }
+    }
+    else
+        run_iterations(&chip, atoi(argv[2]));
 
-    return 0;
+#ifdef CHIP_PROFILER
+    if (profile_path)
+        write_profile(chip.profile, profile_path);
+    profile_detach(&chip);
+#endif
+    if (!trace_detach(&chip)) {
+        perror(trace_path);
+        status = 1;
+    }
+    chip_deinit(&chip);
+    return status;
 }
@@ -0,0 +1,191 @@
+#define _POSIX_C_SOURCE 200809L
+#include "movie.h"
+#include "sched.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FNV_OFFSET 0xCBF29CE484222325ULL
+#define FNV_PRIME  0x100000001B3ULL
+
+static u64 fnv1a(u64 hash, const void *data, size_t size)
+{
+    const u8 *p = data;
+    for (size_t k = 0; k < size; k++) {
+        hash ^= p[k];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+u64 movie_hash_mem(const struct chip8 *chip)
+{
+    u64 hash = FNV_OFFSET;
+    for (u32 k = 0; k < (chip->mem_mask + 1u) >> CHIP_PAGE_SHIFT; k++)
+        hash = fnv1a(hash, chip->pages[k]->data, CHIP_PAGE_SIZE);
+    return hash;
+}
+
+u64 movie_hash_display(const struct chip8 *chip)
+{
+    u64 hash = fnv1a(FNV_OFFSET, chip->display, sizeof(chip->display));
+    hash = fnv1a(hash, chip->display2, sizeof(chip->display2));
+    return fnv1a(hash, &chip->hires, sizeof(chip->hires));
+}
+
+void movie_start(struct chip_movie *movie, struct chip8 *chip, u32 seed, u32 ipf)
+{
+    memset(movie, 0, sizeof(*movie));
+    movie->header.magic = CHIP_MOVIE_MAGIC;
+    movie->header.version = CHIP_MOVIE_VERSION;
+    movie->header.seed = seed;
+    movie->header.quirks = chip->quirks;
+    movie->header.ipf = ipf;
+    movie->header.rom_hash = movie_hash_mem(chip);
+    chip_seed(chip, seed);
+}
+
+void movie_free(struct chip_movie *movie)
+{
+    free(movie->runs);
+    movie->runs = NULL;
+    movie->run_cap = 0;
+    movie->header.run_count = 0;
+}
+
+bool movie_push(struct chip_movie *movie, u16 key_mask)
+{
+    struct movie_header *h = &movie->header;
+    if (h->run_count > 0 && movie->runs[h->run_count - 1].key_mask == key_mask) {
+        movie->runs[h->run_count - 1].frames++;
+        h->frames++;
+        return true;
+    }
+
+    if (h->run_count == movie->run_cap) {
+        u32 cap = movie->run_cap ? movie->run_cap * 2 : 256;
+        struct movie_run *runs = realloc(movie->runs, cap * sizeof(*runs));
+        if (!runs)
+            return false;
+        movie->runs = runs;
+        movie->run_cap = cap;
+    }
+    movie->runs[h->run_count++] = (struct movie_run){ .key_mask = key_mask, .frames = 1 };
+    h->frames++;
+    return true;
+}
+
+void movie_pop(struct chip_movie *movie)
+{
+    struct movie_header *h = &movie->header;
+    if (h->run_count == 0)
+        return;
+    if (--movie->runs[h->run_count - 1].frames == 0)
+        h->run_count--;
+    h->frames--;
+}
+
+void movie_finish(struct chip_movie *movie, const struct chip8 *chip)
+{
+    movie->header.display_hash = movie_hash_display(chip);
+}
+
+bool movie_write(const struct chip_movie *movie, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    const struct movie_header *h = &movie->header;
+    bool ok = fwrite(h, sizeof(*h), 1, f) == 1 &&
+              fwrite(movie->runs, sizeof(*movie->runs), h->run_count, f) == h->run_count;
+    return (fclose(f) == 0) && ok;
+}
+
+bool movie_read(struct chip_movie *movie, const char *path)
+{
+    memset(movie, 0, sizeof(*movie));
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    struct movie_header *h = &movie->header;
+    bool ok = fread(h, sizeof(*h), 1, f) == 1 &&
+              h->magic == CHIP_MOVIE_MAGIC && h->version == CHIP_MOVIE_VERSION && h->quirks < QUIRKS_COUNT;
+    if (ok && h->run_count > 0) {
+        movie->runs = malloc(h->run_count * sizeof(*movie->runs));
+        movie->run_cap = h->run_count;
+        ok = movie->runs && fread(movie->runs, sizeof(*movie->runs), h->run_count, f) == h->run_count;
+    }
+    fclose(f);
+    if (!ok)
+        movie_free(movie);
+    return ok;
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int movie_replay_main(const char *path, const char *program, bool reference)
+{
+    struct chip_movie movie;
+    if (!movie_read(&movie, path)) {
+        fprintf(stderr, "%s: not a movie, or from another version\n", path);
+        return 1;
+    }
+    struct movie_header *h = &movie.header;
+
+    struct chip8 chip;
+    chip_init(&chip);
+    if (!chip_set_quirks(&chip, h->quirks)) {
+        perror("chip_set_quirks");
+        movie_free(&movie);
+        return 1;
+    }
+    enum chip_error err = chip_load(&chip, program);
+    if (err != CHIP_OK) {
+        fprintf(stderr, "%s: %s\n", program, chip_strerror(err));
+        chip_deinit(&chip);
+        movie_free(&movie);
+        return 1;
+    }
+    chip.reference = reference;
+    if (movie_hash_mem(&chip) != h->rom_hash) {
+        fprintf(stderr, "%s: recorded with a different program than %s\n", path, program);
+        chip_deinit(&chip);
+        movie_free(&movie);
+        return 1;
+    }
+    chip_seed(&chip, h->seed);
+
+    // Same frames the GUI ran, minus the waiting
+    struct sched sched;
+    sched_init(&sched, h->ipf, true);
+    double start = now_seconds();
+    for (u32 r = 0; r < h->run_count; r++)
+        for (u32 f = 0; f < movie.runs[r].frames; f++)
+            sched_frame(&sched, &chip, movie.runs[r].key_mask);
+    double seconds = now_seconds() - start;
+
+    u64 hash = movie_hash_display(&chip);
+    u64 instructions = h->frames * sched.ipf;
+    printf("%llu frames (%.1f minutes at 60Hz) in %.3fs, %.0f instructions/sec\n",
+           (unsigned long long)h->frames, h->frames / 3600.0, seconds,
+           seconds > 0 ? instructions / seconds : 0);
+    int status = 0;
+    if (hash != h->display_hash) {
+        printf("MISMATCH: final display hash %016llx, recorded %016llx\n",
+               (unsigned long long)hash, (unsigned long long)h->display_hash);
+        status = 1;
+    }
+    else {
+        printf("display matches (%016llx)\n", (unsigned long long)hash);
+    }
+
+    chip_deinit(&chip);
+    movie_free(&movie);
+    return status;
+}
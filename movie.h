@@ -0,0 +1,58 @@
+#pragma once
+#include "chip8.h"
+
+#define CHIP_MOVIE_MAGIC   0x564D3843 // "C8MV" in a little-endian file
+#define CHIP_MOVIE_VERSION 1
+
+// One key mask held for `frames` frames in a row
+struct movie_run {
+    u16 key_mask;
+    u16 pad;
+    u32 frames;
+};
+
+// Everything needed to play a session again exactly: the machine it started as, then the keys held on every frame.
+// Input only ever reaches the machine once per frame (see sched_frame), so a run of identical frames is one entry and
+// an hour of play is usually a few KB. Files are the header followed by the runs, native endian like state files
+struct movie_header {
+    u32 magic;
+    u32 version;
+    u32 seed;     // chip_seed before the first frame
+    u32 quirks;   // enum chip_quirks
+    u32 ipf;      // Instructions per frame
+    u32 run_count;
+    u64 rom_hash; // movie_hash_mem of the freshly loaded machine, so a movie isn't played against the wrong ROM
+    u64 frames;
+    u64 display_hash; // movie_hash_display after the last frame
+};
+
+struct chip_movie {
+    struct movie_header header;
+    struct movie_run *runs;
+    u32 run_cap;
+};
+
+// FNV-1a of the machine's memory, and of what's on screen (both planes plus the resolution)
+u64 movie_hash_mem(const struct chip8 *chip);
+u64 movie_hash_display(const struct chip8 *chip);
+
+// Start recording a machine that has just been loaded, seeding it with `seed`
+void movie_start(struct chip_movie *movie, struct chip8 *chip, u32 seed, u32 ipf);
+void movie_free(struct chip_movie *movie);
+
+// Record one frame's keys, returns false if out of memory
+bool movie_push(struct chip_movie *movie, u16 key_mask);
+
+// Forget the last recorded frame, for when the frontend rewinds
+void movie_pop(struct chip_movie *movie);
+
+// Note down the final display so replays can be checked against it
+void movie_finish(struct chip_movie *movie, const struct chip8 *chip);
+
+// Save/load a movie, returning false on I/O errors or a version mismatch
+bool movie_write(const struct chip_movie *movie, const char *path);
+bool movie_read(struct chip_movie *movie, const char *path);
+
+// Play a movie on a machine loaded with the same ROM, as fast as the interpreter goes. Returns 0 when the final
+// display matches, prints why otherwise
+int movie_replay_main(const char *path, const char *program, bool reference);
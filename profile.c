@@ -0,0 +1,202 @@
+#include "profile.h"
+
+#ifdef CHIP_PROFILER
+#include "disasm.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define REPORT_TOP 30
+
+static u64 frame_hash(u64 parent, u16 frame)
+{
+    return (parent ^ frame) * 0x100000001B3ULL;
+}
+
+bool profile_attach(struct chip8 *chip)
+{
+    struct chip_profile *p = calloc(1, sizeof(*p));
+    if (!p)
+        return false;
+
+    p->quirks = chip->quirks;
+    p->frames[0] = 0x200;
+    p->hashes[0] = frame_hash(0xCBF29CE484222325ULL, 0x200);
+    chip->profile = p;
+    return true;
+}
+
+void profile_detach(struct chip8 *chip)
+{
+    free(chip->profile);
+    chip->profile = NULL;
+}
+
+static void edge_add(struct chip_profile *p, struct profile_edge *table, u16 from, u16 to)
+{
+    u64 key = ((u64)from << 16 | to) + 1;
+    for (u32 probe = 0; probe < PROFILE_TABLE; probe++) {
+        struct profile_edge *e = &table[(key * 2654435761u + probe) & (PROFILE_TABLE - 1)];
+        if (e->key == key || e->key == 0) {
+            e->key = key;
+            e->count++;
+            return;
+        }
+    }
+    p->lost++;
+}
+
+static void stack_add(struct chip_profile *p)
+{
+    u64 hash = p->hashes[p->depth];
+    for (u32 probe = 0; probe < PROFILE_TABLE; probe++) {
+        struct profile_stack *s = &p->stacks[(hash + probe) & (PROFILE_TABLE - 1)];
+        if (s->count == 0) {
+            s->hash = hash;
+            s->depth = p->depth;
+            memcpy(s->frames, p->frames, (p->depth + 1) * sizeof(u16));
+        }
+        if (s->hash == hash) {
+            s->count++;
+            return;
+        }
+    }
+    p->lost++;
+}
+
+void profile_hit(struct chip_profile *p, u16 pc, u16 instruction)
+{
+    u16 opcode = instruction >> 12;
+    u16 nnn = instruction & 0xFFF;
+    u16 sub = 0;
+    if (opcode == 0x8) sub = instruction & 0xF;
+    else if (opcode == 0x0 || opcode == 0xE || opcode == 0xF) sub = instruction & 0xFF;
+    if ((instruction & 0xFFF0) == 0x00C0) sub = 0xC0; // 00CN/00DN are one class each whatever N is
+    if ((instruction & 0xFFF0) == 0x00D0) sub = 0xD0;
+    if (opcode == 0x5) sub = instruction & 0xF;
+
+    p->total++;
+    p->pc_hits[pc]++;
+    p->pc_insn[pc] = instruction;
+    p->class_hits[opcode << 8 | sub]++;
+    stack_add(p);
+
+    if (opcode == 0x2) {
+        edge_add(p, p->calls, pc, nnn);
+        if (p->overflow || p->depth + 1 >= PROFILE_STACK_MAX) {
+            p->overflow++;
+        }
+        else {
+            p->depth++;
+            p->frames[p->depth] = nnn;
+            p->hashes[p->depth] = frame_hash(p->hashes[p->depth - 1], nnn);
+        }
+    }
+    else if (instruction == 0x00EE) {
+        if (p->overflow) p->overflow--;
+        else if (p->depth > 0) p->depth--;
+    }
+    else if (opcode == 0x1 && nnn <= pc) {
+        edge_add(p, p->loops, pc, nnn);
+    }
+}
+
+static const u64 *sort_counts;
+static int by_count_desc(const void *a, const void *b)
+{
+    u64 ca = sort_counts[*(const u32 *)a], cb = sort_counts[*(const u32 *)b];
+    return (ca < cb) - (ca > cb);
+}
+
+// Indices of the non-zero entries of counts[], biggest first. Caller frees
+static u32 *sorted_indices(const u64 *counts, u32 size, u32 *found)
+{
+    u32 *idx = malloc(size * sizeof(u32));
+    *found = 0;
+    if (!idx)
+        return NULL;
+    for (u32 i = 0; i < size; i++)
+        if (counts[i])
+            idx[(*found)++] = i;
+    sort_counts = counts;
+    qsort(idx, *found, sizeof(u32), by_count_desc);
+    return idx;
+}
+
+static void class_name(u32 class, char *buf, size_t size)
+{
+    static const char *names[16] = {
+        "0NNN", "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "6XNN", "7XNN",
+        "8XY?", "9XY0", "ANNN", "BNNN", "CXNN", "DXYN", "EX??", "FX??",
+    };
+    u32 opcode = class >> 8, sub = class & 0xFF;
+    if (opcode == 0x0 && (sub == 0xC0 || sub == 0xD0)) snprintf(buf, size, "00%XN", sub >> 4);
+    else if (opcode == 0x5) snprintf(buf, size, "5XY%X", sub);
+    else if (opcode == 0x0 && (sub == 0xE0 || sub == 0xEE || sub >= 0xFB)) snprintf(buf, size, "00%02X", sub);
+    else if (opcode == 0x8) snprintf(buf, size, "8XY%X", sub);
+    else if (opcode == 0xE || opcode == 0xF) snprintf(buf, size, "%XX%02X", opcode, sub);
+    else snprintf(buf, size, "%s", names[opcode]);
+}
+
+static void report_edges(const struct profile_edge *table, FILE *out, const char *arrow)
+{
+    u64 counts[PROFILE_TABLE];
+    for (u32 i = 0; i < PROFILE_TABLE; i++)
+        counts[i] = table[i].count;
+
+    u32 found;
+    u32 *idx = sorted_indices(counts, PROFILE_TABLE, &found);
+    for (u32 k = 0; idx && k < found && k < REPORT_TOP; k++) {
+        u64 key = table[idx[k]].key - 1;
+        fprintf(out, "%12llu  0x%03X %s 0x%03X\n", (unsigned long long)counts[idx[k]], (u32)(key >> 16), arrow,
+                (u32)(key & 0xFFFF));
+    }
+    free(idx);
+}
+
+void profile_report(const struct chip_profile *p, FILE *out)
+{
+    char text[32];
+    u32 found, *idx;
+    double total = p->total ? (double)p->total : 1;
+
+    fprintf(out, "# %llu instructions profiled", (unsigned long long)p->total);
+    if (p->lost)
+        fprintf(out, ", %llu samples lost to full tables", (unsigned long long)p->lost);
+    fprintf(out, "\n\n## Top addresses\n%12s %6s  %-5s %-6s %s\n", "count", "%", "addr", "insn", "disassembly");
+    idx = sorted_indices(p->pc_hits, 0x10000, &found);
+    for (u32 k = 0; idx && k < found && k < REPORT_TOP; k++) {
+        u32 pc = idx[k];
+        fprintf(out, "%12llu %6.2f  0x%03X %04X   %s\n", (unsigned long long)p->pc_hits[pc], 100 * p->pc_hits[pc] / total,
+                pc, p->pc_insn[pc], chip_disasm(p->pc_insn[pc], p->quirks, text, sizeof(text)));
+    }
+    free(idx);
+
+    fprintf(out, "\n## Opcode classes\n");
+    idx = sorted_indices(p->class_hits, 0x1000, &found);
+    for (u32 k = 0; idx && k < found; k++) {
+        class_name(idx[k], text, sizeof(text));
+        fprintf(out, "%12llu %6.2f  %s\n", (unsigned long long)p->class_hits[idx[k]], 100 * p->class_hits[idx[k]] / total,
+                text);
+    }
+    free(idx);
+
+    fprintf(out, "\n## Calls (caller -> subroutine)\n");
+    report_edges(p->calls, out, "->");
+
+    fprintf(out, "\n## Hot loops (backward jump -> loop head, count is iterations)\n");
+    report_edges(p->loops, out, "->");
+}
+
+void profile_folded(const struct chip_profile *p, FILE *out)
+{
+    for (u32 i = 0; i < PROFILE_TABLE; i++) {
+        const struct profile_stack *s = &p->stacks[i];
+        if (!s->count)
+            continue;
+        for (int d = 0; d <= s->depth; d++)
+            fprintf(out, "%s0x%03X", d ? ";" : "", s->frames[d]);
+        fprintf(out, " %llu\n", (unsigned long long)s->count);
+    }
+}
+
+#endif
@@ -0,0 +1,62 @@
+#pragma once
+#include "chip8.h"
+#include <stdio.h>
+
+// Instruction profiler, only built with -DCHIP_PROFILER (make profile). Without it PROFILE_HIT compiles to nothing and
+// none of this exists. While a profile is attached chip_run uses the reference interpreter, so every instruction is seen
+#ifdef CHIP_PROFILER
+
+#define PROFILE_TABLE     4096 // Entries per hash table, power of two
+#define PROFILE_STACK_MAX 32   // Calls nested deeper than this are charged to the deepest tracked frame
+
+struct profile_edge {
+    u64 key; // (from << 16 | to) + 1, 0 marks an empty slot
+    u64 count;
+};
+
+struct profile_stack {
+    u64 hash;
+    u64 count; // 0 marks an empty slot
+    u8 depth;
+    u16 frames[PROFILE_STACK_MAX];
+};
+
+struct chip_profile {
+    enum chip_quirks quirks; // Of the machine profiled, for the disassembly
+    u64 total;
+    u64 pc_hits[0x10000]; // Big enough for XO-CHIP's 64KB
+    u16 pc_insn[0x10000]; // Last instruction executed at each address, for the disassembly
+    u64 class_hits[0x1000]; // Keyed by opcode << 8 | the sub-opcode (n for 8XYN, nn for 0NNN/EXNN/FXNN)
+
+    struct profile_edge calls[PROFILE_TABLE]; // 2NNN caller -> callee
+    struct profile_edge loops[PROFILE_TABLE]; // Backward 1NNN jump -> loop head, count is the number of iterations
+    struct profile_stack stacks[PROFILE_TABLE];
+    u64 lost; // Samples dropped because a table filled up
+
+    // Shadow call stack, maintained from 2NNN/00EE. frames[0] is the entry point
+    u16 frames[PROFILE_STACK_MAX];
+    u64 hashes[PROFILE_STACK_MAX];
+    u8 depth;
+    u32 overflow;
+};
+
+// Start profiling `chip`, returns false if out of memory
+bool profile_attach(struct chip8 *chip);
+void profile_detach(struct chip8 *chip);
+
+// Record one executed instruction
+void profile_hit(struct chip_profile *p, u16 pc, u16 instruction);
+
+// Top PCs with disassembly, opcode histogram, call graph and hot loops
+void profile_report(const struct chip_profile *p, FILE *out);
+
+// Collapsed stacks ("0x200;0x24A;0x310 1234" per line), the input format of flamegraph.pl and friends
+void profile_folded(const struct chip_profile *p, FILE *out);
+
+#define PROFILE_HIT(chip, pc, insn) do { if ((chip)->profile) profile_hit((chip)->profile, pc, insn); } while (0)
+
+#else
+
+#define PROFILE_HIT(chip, pc, insn) ((void)0)
+
+#endif
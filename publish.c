@@ -0,0 +1,113 @@
+#define _POSIX_C_SOURCE 200809L
+#include "publish.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define PUBLISH_READ_TRIES 100 // A writer that died halfway through a slot leaves it odd forever, don't spin on it
+
+static bool publish_map(struct publisher *p, const char *name, bool writer)
+{
+    int fd = shm_open(name, writer ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (fd < 0)
+        return false;
+    if (writer && ftruncate(fd, sizeof(struct publish_ring)) != 0) {
+        close(fd);
+        shm_unlink(name);
+        return false;
+    }
+    void *ring = mmap(NULL, sizeof(struct publish_ring), writer ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) {
+        if (writer)
+            shm_unlink(name);
+        return false;
+    }
+
+    p->ring = ring;
+    p->owner = writer;
+    snprintf(p->name, sizeof(p->name), "%s", name);
+    return true;
+}
+
+bool publish_open(struct publisher *p, const char *name)
+{
+    if (!publish_map(p, name, true))
+        return false;
+
+    // Whatever a previous run left in there is stale. Readers check the magic last, so set it after the rest
+    struct publish_ring *r = p->ring;
+    r->magic = 0;
+    r->version = PUBLISH_VERSION;
+    atomic_store(&r->head, 0);
+    for (int k = 0; k < PUBLISH_SLOTS; k++)
+        atomic_store(&r->slots[k].seq, 0);
+    atomic_thread_fence(memory_order_release);
+    r->magic = PUBLISH_MAGIC;
+    return true;
+}
+
+void publish_frame(struct publisher *p, const struct chip8 *chip)
+{
+    struct publish_ring *r = p->ring;
+    u64 head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    struct publish_slot *slot = &r->slots[head & (PUBLISH_SLOTS - 1)];
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    u32 seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->data.frame = head + 1;
+    slot->data.time_ns = (u64)now.tv_sec * 1000000000 + now.tv_nsec;
+    slot->data.hires = chip->hires;
+    slot->data.planes = chip->quirks == QUIRKS_XO ? 2 : 1;
+    memcpy(slot->data.display, chip->display, sizeof(slot->data.display));
+    if (chip->quirks == QUIRKS_XO)
+        memcpy(slot->data.display2, chip->display2, sizeof(slot->data.display2));
+
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+void publish_close(struct publisher *p)
+{
+    if (!p->ring)
+        return;
+    munmap(p->ring, sizeof(struct publish_ring));
+    if (p->owner)
+        shm_unlink(p->name);
+    p->ring = NULL;
+}
+
+bool publish_attach(struct publisher *p, const char *name)
+{
+    return publish_map(p, name, false);
+}
+
+bool publish_read(const struct publisher *p, struct publish_frame *out)
+{
+    const struct publish_ring *r = p->ring;
+    if (r->magic != PUBLISH_MAGIC || r->version != PUBLISH_VERSION)
+        return false;
+
+    for (int tries = 0; tries < PUBLISH_READ_TRIES; tries++) {
+        u64 head = atomic_load_explicit(&r->head, memory_order_acquire);
+        if (head == 0)
+            return false;
+        const struct publish_slot *slot = &r->slots[(head - 1) & (PUBLISH_SLOTS - 1)];
+
+        u32 before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (before & 1)
+            continue;
+        memcpy(out, &slot->data, sizeof(*out));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == before)
+            return true;
+    }
+    return false;
+}
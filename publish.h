@@ -0,0 +1,56 @@
+#pragma once
+#include "chip8.h"
+#include <stdatomic.h>
+
+// Frames published into a POSIX shared memory segment, for viewers and tools in other processes. The emulator only
+// ever writes: each slot is a seqlock, readers copy a slot out and retry if the sequence moved under them, so nothing
+// a reader does can stall the frame loop. chip8-view (viewer.c) is the reference reader
+
+#define PUBLISH_MAGIC   0x47523843 // "C8RG"
+#define PUBLISH_VERSION 1
+#define PUBLISH_SLOTS   8 // Power of two. Readers more than this many frames behind just skip ahead
+
+struct publish_frame {
+    u64 frame;   // Sequence number, counts up from 1 with every published frame
+    u64 time_ns; // CLOCK_MONOTONIC when it was published
+    u8 hires;
+    u8 planes;   // 2 when display2 is in use (XO-CHIP)
+    u8 pad[6];
+    u64 display[DISPLAY_HI_H * 2];
+    u64 display2[DISPLAY_HI_H * 2];
+};
+
+struct publish_slot {
+    _Atomic u32 seq; // Odd while the writer is in the middle of it
+    u32 pad;
+    struct publish_frame data;
+};
+
+// The whole segment
+struct publish_ring {
+    u32 magic;
+    u32 version;
+    _Atomic u64 head; // Frames published so far, the newest is in slot (head - 1) % PUBLISH_SLOTS
+    struct publish_slot slots[PUBLISH_SLOTS];
+};
+
+struct publisher {
+    struct publish_ring *ring;
+    char name[256];
+    bool owner; // Created the segment, so unlinks it on close
+};
+
+// Create (or take over) the segment `name`, which is a shm_open name like "/chip8-1". Returns false with errno set
+bool publish_open(struct publisher *p, const char *name);
+
+// Publish the machine's current display as the next frame
+void publish_frame(struct publisher *p, const struct chip8 *chip);
+
+// Unmap, and remove the segment if publish_open created it
+void publish_close(struct publisher *p);
+
+// Map an existing segment read-only, for readers
+bool publish_attach(struct publisher *p, const char *name);
+
+// Copy out the newest frame. Returns false if nothing has been published yet
+bool publish_read(const struct publisher *p, struct publish_frame *out);
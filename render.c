@@ -0,0 +1,79 @@
+#define _POSIX_C_SOURCE 200809L
+#include "render.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define NSEC 1000000000LL
+#define RENDER_FRESH 4 // Flag on middle, above the slot index
+
+static void *render_thread(void *arg)
+{
+    struct render *r = arg;
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (atomic_load_explicit(&r->running, memory_order_relaxed)) {
+        // Only the renderer clears RENDER_FRESH, so once it's seen the swap is sure to pick up a new frame
+        if (atomic_load_explicit(&r->middle, memory_order_relaxed) & RENDER_FRESH) {
+            r->front = atomic_exchange_explicit(&r->middle, r->front, memory_order_acq_rel) & ~RENDER_FRESH;
+            r->draw(&r->slots[r->front], r->arg);
+            atomic_fetch_add_explicit(&r->drawn, 1, memory_order_relaxed);
+        }
+
+        // Fixed deadlines like sched, but a slow terminal just means skipping ahead rather than catching up
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long deadline = next.tv_sec * NSEC + next.tv_nsec + NSEC / RENDER_HZ;
+        if (now.tv_sec * NSEC + now.tv_nsec > deadline)
+            deadline = now.tv_sec * NSEC + now.tv_nsec;
+        next = (struct timespec){ .tv_sec = deadline / NSEC, .tv_nsec = deadline % NSEC };
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+            ;
+    }
+    return NULL;
+}
+
+bool render_start(struct render *r, render_draw_fn *draw, void *arg)
+{
+    r->draw = draw;
+    r->arg = arg;
+    memset(r->slots, 0, sizeof(r->slots));
+    r->status[0] = '\0';
+    r->back = 0;
+    r->front = 1;
+    atomic_init(&r->middle, 2);
+    atomic_init(&r->running, true);
+    atomic_init(&r->submitted, 0);
+    atomic_init(&r->drawn, 0);
+
+    if (pthread_create(&r->thread, NULL, render_thread, r) != 0) {
+        atomic_store(&r->running, false);
+        return false;
+    }
+    return true;
+}
+
+void render_stop(struct render *r)
+{
+    if (atomic_exchange(&r->running, false))
+        pthread_join(r->thread, NULL);
+}
+
+void render_submit(struct render *r, const struct chip8 *chip)
+{
+    struct render_frame *f = &r->slots[r->back];
+    memcpy(f->display, chip->display, sizeof(f->display));
+    memcpy(f->display2, chip->display2, sizeof(f->display2));
+    f->hires = chip->hires;
+    memcpy(f->status, r->status, sizeof(f->status));
+
+    r->back = atomic_exchange_explicit(&r->middle, r->back | RENDER_FRESH, memory_order_acq_rel) & ~RENDER_FRESH;
+    atomic_fetch_add_explicit(&r->submitted, 1, memory_order_relaxed);
+}
+
+void render_set_status(struct render *r, const char *text)
+{
+    snprintf(r->status, sizeof(r->status), "%s", text);
+}
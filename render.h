@@ -0,0 +1,53 @@
+#pragma once
+#include "chip8.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define RENDER_HZ 60 // How often the render thread looks for a new frame
+#define RENDER_STATUS 128 // Longest status line, terminator included
+
+// Drawing on its own thread, so the emulation loop never waits on the terminal. Finished frames go into a triple
+// buffer: the emulation side fills the back slot and swaps it with the middle one, the render thread swaps the middle
+// one with the slot it draws from whenever it has something new. Neither side ever blocks the other, and frames the
+// renderer didn't get to in time are simply replaced by newer ones
+
+// One finished frame, as much of the machine as drawing it needs. Has the same field names as struct chip8, so the
+// CHIP_* display macros work on it
+struct render_frame {
+    u64 display[DISPLAY_HI_H * 2];
+    u64 display2[DISPLAY_HI_H * 2];
+    bool hires;
+    char status[RENDER_STATUS]; // Line of text to show under the display, empty for none
+};
+
+// Called on the render thread with the newest frame. Frames can be skipped, so compare against what was drawn last
+// rather than trusting chip->dirty
+typedef void render_draw_fn(const struct render_frame *frame, void *arg);
+
+struct render {
+    pthread_t thread;
+    render_draw_fn *draw;
+    void *arg;
+
+    struct render_frame slots[3];
+    u32 back;           // Emulation side only: the slot render_submit fills
+    u32 front;          // Render thread only: the slot last drawn
+    _Atomic u32 middle; // The slot in between, with RENDER_FRESH set while it holds a frame nobody has drawn
+    _Atomic bool running;
+    char status[RENDER_STATUS]; // Emulation side only: what render_submit puts in the next frames
+
+    _Atomic u64 submitted; // Frames handed over so far
+    _Atomic u64 drawn;     // Frames actually drawn, the difference was dropped
+};
+
+// Start the render thread, calling draw(frame, arg) for each frame it picks up
+bool render_start(struct render *r, render_draw_fn *draw, void *arg);
+
+// Stop and join the render thread. Whatever it was drawing is finished first
+void render_stop(struct render *r);
+
+// Hand over the machine's current display as the newest frame. Never waits
+void render_submit(struct render *r, const struct chip8 *chip);
+
+// Show `text` under the display from the next render_submit on
+void render_set_status(struct render *r, const char *text);
@@ -0,0 +1,68 @@
+#define _POSIX_C_SOURCE 200809L
+#include "sched.h"
+#include <errno.h>
+
+#define NSEC 1000000000LL
+#define SCHED_MAX_LAG (NSEC / 4) // Further behind than this (suspended, debugger...) and we stop trying to catch up
+
+static long long ts_ns(const struct timespec *ts)
+{
+    return ts->tv_sec * NSEC + ts->tv_nsec;
+}
+
+void sched_init(struct sched *s, u32 ipf, bool turbo)
+{
+    s->ipf = ipf ? ipf : SCHED_DEFAULT_IPF;
+    s->turbo = turbo;
+    s->idle = false;
+    s->frame = 0;
+    s->overshoot = -1;
+    s->late = 0;
+    s->skipped = 0;
+    clock_gettime(CLOCK_MONOTONIC, &s->start);
+}
+
+bool sched_frame(struct sched *s, struct chip8 *chip, u16 key_mask)
+{
+    // Timers are driven from here rather than deltatime, so they follow emulated frames even in turbo mode
+    bool redraw = chip_run(chip, key_mask, 0, s->ipf);
+    chip_tick(chip);
+    s->idle = chip->idle == CHIP_IDLE_KEY;
+    s->frame++;
+    return redraw;
+}
+
+void sched_wait(struct sched *s)
+{
+    s->overshoot = -1;
+    if (s->turbo && !s->idle)
+        return;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    // Turbo waiting on FX0A: nothing can happen until a key goes down, so sleep a real frame rather than spinning.
+    // Turbo leaves the deadlines far in the future, restart them from here
+    if (s->turbo) {
+        s->start = now;
+        s->frame = 1;
+    }
+    long long deadline = ts_ns(&s->start) + (long long)(s->frame * NSEC / SCHED_HZ);
+
+    if (ts_ns(&now) - deadline > SCHED_MAX_LAG) {
+        s->skipped += (ts_ns(&now) - deadline) / (NSEC / SCHED_HZ);
+        s->start = now;
+        s->frame = 0;
+        return;
+    }
+    if (ts_ns(&now) >= deadline) {
+        s->late++;
+        return;
+    }
+
+    struct timespec ts = { .tv_sec = deadline / NSEC, .tv_nsec = deadline % NSEC };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    s->overshoot = ts_ns(&now) - deadline;
+}
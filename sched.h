@@ -0,0 +1,31 @@
+#pragma once
+#include "chip8.h"
+#include <time.h>
+
+#define SCHED_HZ 60
+#define SCHED_DEFAULT_IPF 11 // ~660 instructions/sec, about what most ROMs were written against
+
+// Frame pacing: every frame runs `ipf` instructions, ticks the timers once and then sleeps to an absolute deadline
+struct sched {
+    u32 ipf;    // Instructions per 60Hz frame
+    bool turbo; // Never sleep, run frames as fast as the host allows
+    bool idle;  // The last frame ended waiting on FX0A, so even turbo mode sleeps until input could change that
+
+    struct timespec start; // Deadlines are start + frame/60s, so rounding never accumulates into drift
+    u64 frame;
+
+    // For telemetry, never reset
+    long long overshoot; // How long after its deadline the last sched_wait woke up in ns, -1 if it didn't sleep
+    u64 late;            // Waits that found the deadline already gone
+    u64 skipped;         // Frames given up on after falling more than SCHED_MAX_LAG behind
+};
+
+// Set up a scheduler, the first frame is due immediately
+void sched_init(struct sched *s, u32 ipf, bool turbo);
+
+// Emulate one frame. Returns whether the display changed (see chip->dirty for which rows)
+bool sched_frame(struct sched *s, struct chip8 *chip, u16 key_mask);
+
+// Sleep until the next frame is due, returns immediately when running late or in turbo mode (unless the program is
+// waiting for a key)
+void sched_wait(struct sched *s);
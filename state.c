@@ -0,0 +1,260 @@
+#include "state.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STATE_WORDS (sizeof(struct chip_state) / sizeof(u64))
+
+// The delta code below works on whole words, so the used part of a state mustn't end in a partial one
+typedef char chip_state_is_whole_words[(offsetof(struct chip_state, mem) % sizeof(u64)) == 0 ? 1 : -1];
+
+// Worst case is every other word changed: a 4-byte run header plus 8 bytes for each changed word
+#define DELTA_MAX (STATE_WORDS * 12 + 4)
+
+void chip_save(const struct chip8 *chip, struct chip_state *state)
+{
+    state->magic = CHIP_STATE_MAGIC;
+    state->version = CHIP_STATE_VERSION;
+
+    memcpy(state->display, chip->display, sizeof(state->display));
+    memcpy(state->display2, chip->display2, sizeof(state->display2));
+    state->mem_size = chip->mem_mask + 1;
+    chip_mem_read(chip, 0, state->mem, state->mem_size);
+    memcpy(state->stack, chip->stack, sizeof(state->stack));
+    state->pc = chip->pc;
+    state->i = chip->i;
+    state->timer = chip->timer;
+    state->rng = chip->rng;
+    memcpy(state->v, chip->v, sizeof(state->v));
+    memcpy(state->rpl, chip->rpl, sizeof(state->rpl));
+    state->sp = chip->sp;
+    state->delay = chip->delay;
+    state->sound = chip->sound;
+    state->hires = chip->hires;
+    state->halted = chip->halted;
+    memcpy(state->pattern, chip->pattern, sizeof(state->pattern));
+    state->planes = chip->planes;
+    state->pitch = chip->pitch;
+    state->pattern_loaded = chip->pattern_loaded;
+}
+
+bool chip_restore(struct chip8 *chip, const struct chip_state *state)
+{
+    if (state->magic != CHIP_STATE_MAGIC || state->version != CHIP_STATE_VERSION)
+        return false;
+    if (state->mem_size != chip->mem_mask + 1u)
+        return false;
+
+    // Only write the words that really changed, so decoded code and pages shared with forks are left alone. Rewinding a
+    // frame usually touches no code at all
+    u64 old_word, new_word;
+    for (size_t a = 0; a < state->mem_size; a += sizeof(u64)) {
+        memcpy(&old_word, &CHIP_MEM(chip, a), sizeof(u64));
+        memcpy(&new_word, &state->mem[a], sizeof(u64));
+        if (old_word != new_word)
+            chip_mem_write(chip, a, &state->mem[a], sizeof(u64));
+    }
+
+    if (chip->hires != (bool)state->hires)
+        chip->dirty = DISPLAY_HI_ALL_ROWS;
+    else if (state->hires) {
+        for (int y = 0; y < DISPLAY_HI_H; y++)
+            if (((chip->display[2*y] ^ state->display[2*y]) | (chip->display[2*y + 1] ^ state->display[2*y + 1]) |
+                 (chip->display2[2*y] ^ state->display2[2*y]) | (chip->display2[2*y + 1] ^ state->display2[2*y + 1])))
+                chip->dirty |= 1ULL << y;
+    }
+    else {
+        for (int y = 0; y < DISPLAY_H; y++)
+            if (chip->display[y] != state->display[y] || chip->display2[y] != state->display2[y])
+                chip->dirty |= 1ULL << y;
+    }
+    memcpy(chip->display, state->display, sizeof(chip->display));
+    memcpy(chip->display2, state->display2, sizeof(chip->display2));
+    chip->hires = state->hires;
+    chip->halted = state->halted;
+    memcpy(chip->pattern, state->pattern, sizeof(chip->pattern));
+    chip->planes = state->planes;
+    chip->pitch = state->pitch;
+    chip->pattern_loaded = state->pattern_loaded;
+
+    memcpy(chip->stack, state->stack, sizeof(chip->stack));
+    chip->pc = state->pc;
+    chip->i = state->i;
+    chip->timer = state->timer;
+    chip->rng = state->rng;
+    memcpy(chip->v, state->v, sizeof(chip->v));
+    memcpy(chip->rpl, state->rpl, sizeof(chip->rpl));
+    chip->sp = state->sp;
+    chip->delay = state->delay;
+    chip->sound = state->sound;
+    return true;
+}
+
+bool chip_state_write(const struct chip_state *state, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+    bool ok = fwrite(state, chip_state_size(state), 1, f) == 1;
+    return (fclose(f) == 0) && ok;
+}
+
+bool chip_state_read(struct chip_state *state, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+    bool ok = fread(state, offsetof(struct chip_state, mem), 1, f) == 1 &&
+              state->magic == CHIP_STATE_MAGIC && state->version == CHIP_STATE_VERSION &&
+              (state->mem_size == 0x1000 || state->mem_size == 0x10000) &&
+              fread(state->mem, state->mem_size, 1, f) == 1;
+    fclose(f);
+    return ok;
+}
+
+// Deltas are a list of runs: u16 words to skip, u16 words that follow, then those words of a XOR b.
+// Both states must be the same size
+static u32 delta_encode(const struct chip_state *a, const struct chip_state *b, u8 *out)
+{
+    const u64 *wa = (const u64 *)a, *wb = (const u64 *)b;
+    size_t words = chip_state_size(a) / sizeof(u64);
+    u32 size = 0;
+    size_t w = 0;
+    while (w < words) {
+        size_t start = w;
+        while (w < words && wa[w] == wb[w])
+            w++;
+        if (w == words)
+            break;
+
+        u16 skip = w - start, len = 0;
+        u8 *header = &out[size];
+        size += 4;
+        while (w < words && wa[w] != wb[w]) {
+            u64 x = wa[w] ^ wb[w];
+            memcpy(&out[size], &x, sizeof(x));
+            size += sizeof(x);
+            len++;
+            w++;
+        }
+        memcpy(header, &skip, sizeof(skip));
+        memcpy(header + 2, &len, sizeof(len));
+    }
+    return size;
+}
+
+static void delta_apply(struct chip_state *state, const u8 *in, u32 size)
+{
+    u64 *w = (u64 *)state;
+    u32 pos = 0;
+    while (pos < size) {
+        u16 skip, len;
+        memcpy(&skip, &in[pos], sizeof(skip));
+        memcpy(&len, &in[pos + 2], sizeof(len));
+        pos += 4;
+        w += skip;
+        for (u16 k = 0; k < len; k++, w++, pos += sizeof(u64)) {
+            u64 x;
+            memcpy(&x, &in[pos], sizeof(x));
+            *w ^= x;
+        }
+    }
+}
+
+bool chip_rewind_init(struct chip_rewind *rw, size_t bytes)
+{
+    memset(rw, 0, sizeof(*rw));
+    if (bytes < DELTA_MAX)
+        bytes = DELTA_MAX;
+
+    // Even empty deltas take an entry, budget for a few header-only frames per KB
+    rw->max_entries = bytes / 16;
+    rw->ring_size = bytes;
+    rw->ring = malloc(bytes);
+    rw->entries = malloc(rw->max_entries * sizeof(*rw->entries));
+    rw->scratch = malloc(DELTA_MAX);
+    if (!rw->ring || !rw->entries || !rw->scratch) {
+        chip_rewind_free(rw);
+        return false;
+    }
+    return true;
+}
+
+void chip_rewind_free(struct chip_rewind *rw)
+{
+    free(rw->ring);
+    free(rw->entries);
+    free(rw->scratch);
+    memset(rw, 0, sizeof(*rw));
+}
+
+static void rewind_drop_oldest(struct chip_rewind *rw)
+{
+    rw->ring_used -= rw->entries[rw->first].size;
+    rw->first = (rw->first + 1) % rw->max_entries;
+    rw->count--;
+}
+
+void chip_rewind_push(struct chip_rewind *rw, const struct chip8 *chip)
+{
+    struct chip_state *cur = &rw->current;
+    chip_save(chip, cur);
+
+    // A machine switched to or from XO-CHIP can't be rewound past the switch
+    if (rw->has_newest && cur->mem_size != rw->newest.mem_size) {
+        while (rw->count > 0)
+            rewind_drop_oldest(rw);
+        rw->has_newest = false;
+    }
+
+    if (rw->has_newest) {
+        // Backward delta, so newest ^ delta gives the previous frame and the oldest entries can simply be forgotten
+        u32 size = delta_encode(cur, &rw->newest, rw->scratch);
+        while (rw->count > 0 && (rw->ring_used + size > rw->ring_size || rw->count == rw->max_entries))
+            rewind_drop_oldest(rw);
+
+        u32 slot = (rw->first + rw->count) % rw->max_entries;
+        rw->entries[slot].offset = rw->ring_head;
+        rw->entries[slot].size = size;
+        rw->count++;
+
+        size_t tail = rw->ring_size - rw->ring_head;
+        if (size <= tail) {
+            memcpy(&rw->ring[rw->ring_head], rw->scratch, size);
+        }
+        else {
+            memcpy(&rw->ring[rw->ring_head], rw->scratch, tail);
+            memcpy(rw->ring, rw->scratch + tail, size - tail);
+        }
+        rw->ring_head = (rw->ring_head + size) % rw->ring_size;
+        rw->ring_used += size;
+    }
+
+    memcpy(&rw->newest, cur, chip_state_size(cur));
+    rw->has_newest = true;
+}
+
+bool chip_rewind_pop(struct chip_rewind *rw, struct chip8 *chip)
+{
+    if (rw->count == 0)
+        return false;
+
+    u32 slot = (rw->first + rw->count - 1) % rw->max_entries;
+    struct rewind_entry *e = &rw->entries[slot];
+    size_t tail = rw->ring_size - e->offset;
+    if (e->size <= tail) {
+        delta_apply(&rw->newest, &rw->ring[e->offset], e->size);
+    }
+    else {
+        memcpy(rw->scratch, &rw->ring[e->offset], tail);
+        memcpy(rw->scratch + tail, rw->ring, e->size - tail);
+        delta_apply(&rw->newest, rw->scratch, e->size);
+    }
+
+    rw->ring_head = e->offset;
+    rw->ring_used -= e->size;
+    rw->count--;
+
+    chip_restore(chip, &rw->newest);
+    return true;
+}
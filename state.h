@@ -0,0 +1,80 @@
+#pragma once
+#include "chip8.h"
+#include <stddef.h>
+
+#define CHIP_STATE_MAGIC   0x54533843 // "C8ST" in a little-endian file
+#define CHIP_STATE_VERSION 3
+
+// Everything needed to resume a machine. Laid out without padding, files are raw dumps of this struct (native endian).
+// Only the first chip_state_size() bytes are used: mem comes last and is as big as the machine's, so a 4KB machine's
+// state never touches the 60KB an XO-CHIP one would need
+struct chip_state {
+    u32 magic;
+    u32 version;
+
+    u64 display[DISPLAY_HI_H * 2];
+    u64 display2[DISPLAY_HI_H * 2];
+    u16 stack[48];
+    u16 pc;
+    u16 i;
+    u32 timer;
+    u32 rng;
+    u32 mem_size;
+    u8 v[16];
+    u8 rpl[16];
+    u8 pattern[16];
+    u8 sp;
+    u8 delay;
+    u8 sound;
+    u8 hires;
+    u8 halted;
+    u8 planes;
+    u8 pitch;
+    u8 pattern_loaded; // Was padding, so older snapshots restore with the buzzer
+    u8 mem[0x10000];
+};
+
+// Bytes of `state` in use
+#define chip_state_size(state) (offsetof(struct chip_state, mem) + (state)->mem_size)
+
+// Snapshot a machine
+void chip_save(const struct chip8 *chip, struct chip_state *state);
+
+// Resume from a snapshot, only invalidating the decoded code and display rows that actually differ.
+// Returns false (leaving the machine alone) if the snapshot is from another version or a machine with other memory
+bool chip_restore(struct chip8 *chip, const struct chip_state *state);
+
+// Save/load a snapshot to/from a file, returning false on I/O errors or a version mismatch
+bool chip_state_write(const struct chip_state *state, const char *path);
+bool chip_state_read(struct chip_state *state, const char *path);
+
+// Rewind history: a state per frame, kept as backward XOR deltas from the newest one in a fixed-size byte ring.
+// Consecutive frames differ in a handful of words, so each entry is usually tens of bytes rather than a full state.
+// When the ring is full the oldest frames are dropped
+struct chip_rewind {
+    struct chip_state newest;
+    struct chip_state current; // Where push snapshots the machine, too big for the stack
+    bool has_newest;
+
+    u8 *ring; // Encoded deltas, see delta_encode in state.c
+    size_t ring_size;
+    size_t ring_used;
+    size_t ring_head; // Where the next delta gets written
+
+    struct rewind_entry { size_t offset; u32 size; } *entries; // Oldest first, circular
+    u32 max_entries;
+    u32 first;
+    u32 count;
+
+    u8 *scratch; // Room for one worst-case delta
+};
+
+// Allocate `bytes` worth of history, returns false if out of memory
+bool chip_rewind_init(struct chip_rewind *rw, size_t bytes);
+void chip_rewind_free(struct chip_rewind *rw);
+
+// Record the machine's current state, call once per frame
+void chip_rewind_push(struct chip_rewind *rw, const struct chip8 *chip);
+
+// Step one recorded frame back and restore it into `chip`. Returns false when there is no older frame
+bool chip_rewind_pop(struct chip_rewind *rw, struct chip8 *chip);
@@ -0,0 +1,143 @@
+#define _POSIX_C_SOURCE 200809L
+#include "telemetry.h"
+#include <string.h>
+#include <time.h>
+
+#define NSEC 1000000000LL
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NSEC + ts.tv_nsec;
+}
+
+static void hist_add(struct telemetry_hist *h, long long ns)
+{
+    u64 us = ns > 0 ? (u64)ns / 1000 : 0;
+    int b = us ? 64 - __builtin_clzll(us) : 0;
+    h->counts[b < TELEMETRY_BUCKETS ? b : TELEMETRY_BUCKETS - 1]++;
+    h->count++;
+    if (ns > h->max_ns)
+        h->max_ns = ns;
+}
+
+// Upper edge in us of the bucket holding the p'th percentile, 0 if there's nothing in there
+static u64 hist_percentile(const struct telemetry_hist *h, int p)
+{
+    u64 want = ((u64)h->count * p + 99) / 100, seen = 0;
+    for (int b = 0; b < TELEMETRY_BUCKETS && h->count; b++) {
+        seen += h->counts[b];
+        if (seen >= want)
+            return 1ULL << b;
+    }
+    return 0;
+}
+
+static void hist_write(const struct telemetry_hist *h, const char *name, FILE *f)
+{
+    fprintf(f, " %s_n=%u %s_us_p50=%llu %s_us_p99=%llu %s_us_max=%llu %s_us_hist=",
+            name, h->count, name, (unsigned long long)hist_percentile(h, 50), name,
+            (unsigned long long)hist_percentile(h, 99), name, (unsigned long long)(h->max_ns / 1000), name);
+    for (int b = 0; b < TELEMETRY_BUCKETS; b++)
+        fprintf(f, b ? ",%u" : "%u", h->counts[b]);
+}
+
+// Turn the window that started at t->window_ns into a status line and a line in t->out, then start the next one
+static void telemetry_window(struct telemetry *t, long long now)
+{
+    long long elapsed = now - t->window_ns;
+    if (elapsed <= 0)
+        return;
+    u64 insns = t->chip->insns - t->insns, draws = t->chip->draws - t->draws;
+    u64 late = t->sched->late - t->late, skipped = t->sched->skipped - t->skipped;
+    u64 dropped = t->dropped_now - t->dropped;
+#define PER_SEC(n) ((unsigned long long)((double)(n) * NSEC / elapsed + 0.5))
+
+    char key[24] = "-";
+    if (t->key.count)
+        snprintf(key, sizeof(key), "%llums", (unsigned long long)(hist_percentile(&t->key, 50) + 999) / 1000);
+    snprintf(t->status, sizeof(t->status), "%llu ips %llu fps | work p99 %lluus sleep p99 %lluus | key %s | late %llu skip %llu drop %llu",
+             PER_SEC(insns), PER_SEC(t->frames), (unsigned long long)hist_percentile(&t->work, 99),
+             (unsigned long long)hist_percentile(&t->sleep, 99), key, (unsigned long long)late,
+             (unsigned long long)skipped, (unsigned long long)dropped);
+
+    if (t->out) {
+        fprintf(t->out, "t=%.3f ips=%llu draws_ps=%llu redraws_ps=%llu fps=%llu late=%llu skipped=%llu dropped=%llu",
+                (double)(now - t->start_ns) / NSEC, PER_SEC(insns), PER_SEC(draws), PER_SEC(t->redraws),
+                PER_SEC(t->frames), (unsigned long long)late, (unsigned long long)skipped, (unsigned long long)dropped);
+        hist_write(&t->work, "work", t->out);
+        hist_write(&t->sleep, "sleep", t->out);
+        hist_write(&t->key, "key", t->out);
+        fputc('\n', t->out);
+        fflush(t->out);
+    }
+#undef PER_SEC
+
+    t->window_ns = now;
+    t->insns = t->chip->insns;
+    t->draws = t->chip->draws;
+    t->late = t->sched->late;
+    t->skipped = t->sched->skipped;
+    t->dropped = t->dropped_now;
+    t->frames = t->redraws = 0;
+    memset(&t->work, 0, sizeof(t->work));
+    memset(&t->sleep, 0, sizeof(t->sleep));
+    memset(&t->key, 0, sizeof(t->key));
+}
+
+void telemetry_init(struct telemetry *t, const struct chip8 *chip, const struct sched *s, FILE *out)
+{
+    memset(t, 0, sizeof(*t));
+    t->chip = chip;
+    t->sched = s;
+    t->out = out;
+    t->start_ns = t->window_ns = t->frame_ns = now_ns();
+    t->insns = chip->insns;
+    t->draws = chip->draws;
+    t->late = s->late;
+    t->skipped = s->skipped;
+    strcpy(t->status, "measuring...");
+}
+
+void telemetry_keys(struct telemetry *t, u16 key_mask)
+{
+    t->frame_ns = now_ns();
+    // Only the first press counts until a draw answers it, anything pressed in between is answered by the same draw
+    if ((key_mask & ~t->keys) && !t->key_ns) {
+        t->key_ns = t->frame_ns;
+        t->key_draws = t->chip->draws;
+    }
+    t->keys = key_mask;
+}
+
+bool telemetry_frame(struct telemetry *t, bool redrawn, u64 dropped)
+{
+    long long now = now_ns();
+    hist_add(&t->work, now - t->frame_ns);
+    t->frames++;
+    t->redraws += redrawn;
+    t->dropped_now = dropped;
+
+    if (t->key_ns && t->chip->draws != t->key_draws) {
+        hist_add(&t->key, now - t->key_ns);
+        t->key_ns = 0;
+    }
+
+    if (now - t->window_ns < TELEMETRY_WINDOW_NS)
+        return false;
+    telemetry_window(t, now);
+    return true;
+}
+
+void telemetry_slept(struct telemetry *t)
+{
+    if (t->sched->overshoot >= 0)
+        hist_add(&t->sleep, t->sched->overshoot);
+}
+
+void telemetry_finish(struct telemetry *t)
+{
+    if (t->frames)
+        telemetry_window(t, now_ns());
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "chip8.h"
+#include "sched.h"
+#include <stdio.h>
+
+// Live numbers on how the GUI loop is keeping up: instructions, draws and redraws per second, frames that ran late or
+// were given up on, how long each frame's work and each sleep took, and how long a key press takes to reach the
+// display. Everything is counted every frame whether anyone looks or not, it's a few additions and two clock reads per
+// 60Hz frame. Once a second the counts are turned into a status line and, if there's a file, a line of key=value pairs:
+//
+//   t=3.000 ips=660 draws_ps=58 redraws_ps=30 fps=60 late=0 skipped=0 dropped=0 work_n=60 work_us_p50=16
+//   work_us_p99=32 work_us_max=27 work_us_hist=0,0,0,12,40,8,0,... sleep_n=60 sleep_us_p50=64 ... key_n=1 ...
+//
+// All on one line. Percentiles are the upper edge of the histogram bucket they fall in. Each line only covers its own
+// window, so the histograms of a whole run are the sum of its lines
+
+#define TELEMETRY_WINDOW_NS 1000000000LL // How often the numbers are rolled over
+#define TELEMETRY_BUCKETS   24 // Bucket 0 is under 1us, bucket b is [2^(b-1), 2^b) us, the last one also takes anything longer
+#define TELEMETRY_STATUS    128
+
+struct telemetry_hist {
+    u32 counts[TELEMETRY_BUCKETS];
+    u32 count;
+    long long max_ns;
+};
+
+struct telemetry {
+    const struct chip8 *chip;
+    const struct sched *sched;
+    FILE *out; // Where to write the key=value lines, NULL for nowhere
+
+    long long start_ns;  // telemetry_init, the t= in the lines is relative to this
+    long long window_ns; // Start of the current window
+    long long frame_ns;  // Start of the current frame
+
+    // Counts at the start of the window, or within it for the ones telemetry keeps itself
+    u64 insns, draws, late, skipped, dropped;
+    u64 frames, redraws;
+    u64 dropped_now; // Latest total passed to telemetry_frame
+
+    struct telemetry_hist work;  // telemetry_keys to telemetry_frame: emulating or rewinding, audio, publishing
+    struct telemetry_hist sleep; // How late sched_wait woke up
+    struct telemetry_hist key;   // Key showing up in the mask to the end of the frame that ran the next DXYN
+
+    u16 keys;          // Last frame's key mask
+    long long key_ns;  // When a key went down that no DXYN has answered yet, 0 if none
+    u64 key_draws;     // chip->draws back then
+
+    char status[TELEMETRY_STATUS]; // Summary of the last full window, for a status line
+};
+
+// Start counting for `chip` paced by `s`. Both are only read
+void telemetry_init(struct telemetry *t, const struct chip8 *chip, const struct sched *s, FILE *out);
+
+// Start of a frame, with the keys it's going to run with
+void telemetry_keys(struct telemetry *t, u16 key_mask);
+
+// End of a frame's work. `redrawn` is whether it handed over a new display, `dropped` the total frames the renderer
+// has skipped so far. Returns true when a window just closed and t->status changed
+bool telemetry_frame(struct telemetry *t, bool redrawn, u64 dropped);
+
+// After sched_wait
+void telemetry_slept(struct telemetry *t);
+
+// Write out whatever the last window got to
+void telemetry_finish(struct telemetry *t);
@@ -0,0 +1,106 @@
+#define _POSIX_C_SOURCE 200809L
+#include "trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TRACE_IDLE_NS 1000000 // How long the writer naps when the ring is empty
+
+struct trace_writer {
+    pthread_t thread;
+    FILE *file;
+    atomic_bool stop;
+    bool failed;
+};
+
+// Write out everything between tail and head. The ring wraps, so that's at most two contiguous pieces
+static void trace_drain(struct chip_trace *t)
+{
+    struct trace_writer *w = t->writer;
+    u64 head = atomic_load_explicit(&t->head, memory_order_acquire);
+    u64 tail = atomic_load_explicit(&t->tail, memory_order_relaxed);
+    while (tail != head) {
+        u64 start = tail & (TRACE_RING - 1);
+        u64 count = head - tail;
+        if (count > TRACE_RING - start)
+            count = TRACE_RING - start;
+
+        // After a write error keep consuming anyway, or the interpreter would wait on a full ring forever
+        if (!w->failed && fwrite(&t->ring[start], sizeof(*t->ring), count, w->file) != count)
+            w->failed = true;
+        tail += count;
+        atomic_store_explicit(&t->tail, tail, memory_order_release);
+    }
+}
+
+static void *trace_thread(void *arg)
+{
+    struct chip_trace *t = arg;
+    while (!atomic_load_explicit(&t->writer->stop, memory_order_acquire)) {
+        trace_drain(t);
+        nanosleep(&(struct timespec){ .tv_nsec = TRACE_IDLE_NS }, NULL);
+    }
+    trace_drain(t);
+    return NULL;
+}
+
+bool trace_attach(struct chip8 *chip, const char *path)
+{
+    struct chip_trace *t = calloc(1, sizeof(*t));
+    struct trace_writer *w = calloc(1, sizeof(*w));
+    struct trace_record *ring = malloc(TRACE_RING * sizeof(*ring));
+    FILE *f = NULL;
+    if (!t || !w || !ring)
+        goto fail;
+
+    f = fopen(path, "wb");
+    if (!f)
+        goto fail;
+    struct trace_header header = {
+        .magic = TRACE_MAGIC,
+        .version = TRACE_VERSION,
+        .record_size = sizeof(struct trace_record),
+        .quirks = chip->quirks,
+    };
+    if (fwrite(&header, sizeof(header), 1, f) != 1)
+        goto fail;
+
+    t->ring = ring;
+    t->writer = w;
+    w->file = f;
+    atomic_init(&t->head, 0);
+    atomic_init(&t->tail, 0);
+    atomic_init(&w->stop, false);
+    if (pthread_create(&w->thread, NULL, trace_thread, t) != 0)
+        goto fail;
+
+    chip->trace = t;
+    return true;
+
+fail:
+    if (f)
+        fclose(f);
+    free(ring);
+    free(w);
+    free(t);
+    return false;
+}
+
+bool trace_detach(struct chip8 *chip)
+{
+    struct chip_trace *t = chip->trace;
+    if (!t)
+        return true;
+    chip->trace = NULL;
+
+    struct trace_writer *w = t->writer;
+    atomic_store_explicit(&w->stop, true, memory_order_release);
+    pthread_join(w->thread, NULL);
+    bool ok = !w->failed;
+    ok &= fclose(w->file) == 0;
+
+    free(t->ring);
+    free(w);
+    free(t);
+    return ok;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "chip8.h"
+#include <stdatomic.h>
+#include <time.h>
+
+// Execution trace: one fixed-size record per instruction, pushed into a ring the interpreter never blocks on a lock
+// for, and written out to a file by a background thread. chip8-trace (tracedump.c) turns a file back into disassembly.
+// While a trace is attached chip_run uses the reference interpreter, like the profiler
+
+#define TRACE_MAGIC   0x52543843 // "C8TR" in a little-endian file
+#define TRACE_VERSION 1
+#define TRACE_RING    (1 << 16) // Records, power of two. 1MB, a few milliseconds of interpreter at full speed
+
+// Files are a trace_header then records until the end, native endian
+struct trace_header {
+    u32 magic;
+    u32 version;
+    u32 record_size;
+    u32 quirks; // enum chip_quirks the trace was run under, chip8-trace disassembles with that profile's instruction set
+};
+
+struct trace_record {
+    u64 cycle; // Instructions since the trace was attached
+    u16 pc;    // Where the instruction was fetched from
+    u16 instruction;
+    u16 i;     // I after the instruction
+    u8 reg;    // Register the instruction changed, 0xFF for none. vX wins over vF when both did
+    u8 value;  // Its new value
+};
+
+struct trace_writer;
+
+// Single producer (the interpreter), single consumer (the writer thread). Each side only ever stores its own index
+struct chip_trace {
+    struct trace_record *ring;
+    _Atomic u64 head; // Next record the interpreter fills
+    _Atomic u64 tail; // Next record the writer drains
+    u64 cycle;
+    u64 stalls; // Times the ring was full and the interpreter had to wait for the writer
+    struct trace_writer *writer; // Thread and file, private to trace.c
+};
+
+// Start tracing `chip` into a new file at `path`, returns false (with errno) if it couldn't be created
+bool trace_attach(struct chip8 *chip, const char *path);
+
+// Write out everything still in the ring and close the file. Returns false if any of the writes failed
+bool trace_detach(struct chip8 *chip);
+
+// Hand one record to the writer. A full ring waits rather than dropping records, a trace with holes in it is useless
+static inline void trace_push(struct chip_trace *t, const struct trace_record *r)
+{
+    u64 head = atomic_load_explicit(&t->head, memory_order_relaxed);
+    while (head - atomic_load_explicit(&t->tail, memory_order_acquire) == TRACE_RING) {
+        t->stalls++;
+        nanosleep(&(struct timespec){ .tv_nsec = 100000 }, NULL);
+    }
+    t->ring[head & (TRACE_RING - 1)] = *r;
+    atomic_store_explicit(&t->head, head + 1, memory_order_release);
+}
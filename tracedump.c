@@ -0,0 +1,47 @@
+#define _POSIX_C_SOURCE 200809L
+// chip8-trace: print a trace written by chip8 -T as one line of disassembly per instruction
+#include "trace.h"
+#include "disasm.h"
+#include <stdio.h>
+
+#define CHUNK 4096 // Records read per fread
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        printf("Usage: ./chip8-trace FILE\n"
+               "\tFILE\tTrace written by ./chip8 -T FILE\n");
+        return 1;
+    }
+
+    FILE *f = fopen(argv[1], "rb");
+    if (!f) {
+        perror(argv[1]);
+        return 1;
+    }
+    struct trace_header header;
+    if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != TRACE_MAGIC ||
+        header.version != TRACE_VERSION || header.record_size != sizeof(struct trace_record) ||
+        header.quirks >= QUIRKS_COUNT) {
+        fprintf(stderr, "%s: not a trace, or from another version\n", argv[1]);
+        fclose(f);
+        return 1;
+    }
+
+    static struct trace_record records[CHUNK];
+    size_t count;
+    char text[32];
+    while ((count = fread(records, sizeof(*records), CHUNK, f)) > 0) {
+        for (size_t k = 0; k < count; k++) {
+            const struct trace_record *r = &records[k];
+            chip_disasm(r->instruction, header.quirks, text, sizeof(text));
+            printf("%10llu  %04X  %04X  %-20s I=%04X", (unsigned long long)r->cycle, r->pc, r->instruction, text, r->i);
+            if (r->reg != 0xFF)
+                printf("  V%X=%02X", r->reg, r->value);
+            putchar('\n');
+        }
+    }
+
+    fclose(f);
+    return 0;
+}
@@ -1,19 +1,117 @@
 #define NCURSES_WIDECHAR 1
 #define _XOPEN_SOURCE 700
 #include "ui.h"
-#include "beep.h"
+#include "sched.h"
+#include "state.h"
+#include "input.h"
+#include "audio.h"
+#include "render.h"
+#include "telemetry.h"
 #include <ncursesw/ncurses.h>
+#include <string.h>
 #include <wchar.h>
 #include <locale.h>
 
-void gui_main(struct chip8 *chip)
+// Repaint the text rows covering the display rows set in `rows` (each text row is two display rows of half blocks).
+// ncurses then only sends the cells that actually differ, so a small sprite costs a few bytes on the wire.
+// Hi-res is the same at one column per pixel, so it needs a 132 column terminal to be seen whole
+static void gui_draw(const struct render_frame *f, u64 rows_dirty)
 {
-    const int deltatime = 1; // 1ms per redraw
-    int rows, cols;
-    bool ui_running = true;
     const wchar_t *tb = L"\u2588",
                   *t_ = L"\u2580",
                   *_b = L"\u2584";
+    int rows, cols;
+
+    getmaxyx(stdscr, rows, cols);
+    (void)rows;
+    cols -= 2;
+    if (cols > CHIP_W(f)) cols = CHIP_W(f);
+
+    for (int y = 0; y < CHIP_H(f); y+=2) {
+        if (!(rows_dirty & (3ULL << y)))
+            continue;
+
+        move(1 + y/2, 2);
+        for (int x = 0; x < cols; x++) {
+            bool top = CHIP_GET(f, x, y);
+            bool bottom = CHIP_GET(f, x, y+1);
+            if (top && bottom)
+                addwstr(tb);
+            else if (top && !bottom)
+                addwstr(t_);
+            else if (!top && bottom)
+                addwstr(_b);
+            else
+                addch(' ');
+        }
+    }
+}
+
+// The frame around the display, only drawn again when the resolution changes since nothing else paints over it
+static void gui_draw_border(int w, int h)
+{
+    erase();
+    for (int y = 0; y < h/2 + 2; y++) {
+        bool edge = (y == 0 || y == h/2 + 1);
+        mvaddch(y, 0, edge ? 'O' : '|');
+        for (int x = 1; x < w + 3; x++)
+            addch(edge ? '-' : ' ');
+        addch(edge ? 'O' : '|');
+    }
+}
+
+// What the terminal is showing, owned by the render thread
+struct gui_screen {
+    struct render_frame shown;
+    bool valid; // Nothing drawn yet
+};
+
+// Render thread callback. Frames in between may have been dropped, so rows are diffed against the last frame drawn
+// rather than taken from chip->dirty
+static void gui_present(const struct render_frame *f, void *arg)
+{
+    struct gui_screen *screen = arg;
+    u64 rows = 0;
+    bool status = strcmp(f->status, screen->shown.status) != 0;
+    if (!screen->valid || f->hires != screen->shown.hires) {
+        gui_draw_border(CHIP_W(f), CHIP_H(f));
+        rows = CHIP_ALL_ROWS(f);
+        status = true;
+    }
+    else {
+        int words = f->hires ? 2 : 1;
+        for (int y = 0; y < CHIP_H(f); y++) {
+            for (int w = 0; w < words; w++) {
+                int k = y * words + w;
+                if (f->display[k] != screen->shown.display[k] || f->display2[k] != screen->shown.display2[k])
+                    rows |= 1ULL << y;
+            }
+        }
+    }
+    if (!rows && !status)
+        return;
+
+    gui_draw(f, rows);
+    if (status) {
+        mvaddstr(CHIP_H(f)/2 + 2, 0, f->status);
+        clrtoeol();
+    }
+    refresh();
+    screen->shown = *f;
+    screen->valid = true;
+}
+
+void gui_main(struct chip8 *chip, const struct gui_opts *opts)
+{
+    bool ui_running = true;
+    struct sched sched;
+    struct input input;
+    static struct audio audio; // Holds a second of wave table, keep it off the stack
+    static struct render render; // Three frames of display
+    static struct gui_screen screen;
+    static struct telemetry telemetry;
+    struct chip_rewind rewind;
+    bool can_rewind = opts->rewind_kb > 0 && chip_rewind_init(&rewind, (size_t)opts->rewind_kb * 1024);
     
     // Setup the terminal such that we can get all characters and reading a char doesn't block
     setlocale(LC_ALL, "");
@@ -23,101 +121,86 @@ void gui_main(struct chip8 *chip)
     keypad(stdscr, TRUE);
     noecho();
     nodelay(stdscr, TRUE);
+    typeahead(-1); // stdin belongs to the input thread, ncurses mustn't peek at it while refreshing
+    curs_set(0); // Hide cursor
+
+    if (!input_start(&input)) {
+        endwin();
+        perror("input_start");
+        if (can_rewind)
+            chip_rewind_free(&rewind);
+        return;
+    }
 
-    beep_h(440, 1000);
+    // From here on only the render thread touches the screen, until render_stop
+    screen.valid = false;
+    if (!render_start(&render, gui_present, &screen)) {
+        input_stop(&input);
+        endwin();
+        perror("render_start");
+        if (can_rewind)
+            chip_rewind_free(&rewind);
+        return;
+    }
 
-    // Go away debug!
-    chip->debug = false;
+    // No sound card is no reason not to play, carry on silently
+    if (!audio_open(&audio, opts->audio))
+        audio_open(&audio, "null");
 
-    // Mainloop
-    while (ui_running) {
-        curs_set(0); // Hide cursor
+    chip->dirty = CHIP_ALL_ROWS(chip);
 
-        u16 key_mask = gui_get_key_mask(deltatime);
-        if (key_mask == 0xFFFF)
+    // Mainloop, one iteration per 60Hz frame
+    sched_init(&sched, opts->ipf, opts->turbo);
+    telemetry_init(&telemetry, chip, &sched, opts->metrics);
+    if (opts->status)
+        render_set_status(&render, telemetry.status);
+    while (ui_running) {
+        u16 key_mask = input_key_mask(&input);
+        telemetry_keys(&telemetry, key_mask);
+        if (input_quit(&input))
             ui_running = false;
         
-        bool screen_update = chip_cycle(chip, key_mask, deltatime);
-        if (screen_update) {
-            getmaxyx(stdscr, rows, cols);
-            if (rows > DISPLAY_H) rows = DISPLAY_H;
-            if (cols > DISPLAY_W) cols = DISPLAY_W;
-            erase();
-            move(0, 0);
-
-            printw("O------------------------------------------------------------------O\n");
-            for (int y = 0; y < DISPLAY_H; y+=2) {
-                printw("| ");
-                for (int x = 0; x < cols; x++) {
-                    bool top = DISPLAY_GET(chip->display, x, y);
-                    bool bottom = DISPLAY_GET(chip->display, x, y+1);
-                    if (top && bottom)
-                        addwstr(tb);
-                    else if (top && !bottom)
-                        addwstr(t_);
-                    else if (!top && bottom)
-                        addwstr(_b);
-                    else
-                        printw(" ");
-                }
-                printw(" |\n");
-            }
-            printw("O------------------------------------------------------------------O");
+        // Holding backspace plays the recorded frames backwards instead of emulating
+        // The movie follows along, so a rewound recording replays as if those frames never happened
+        if (input_rewinding(&input) && can_rewind) {
+            if (chip_rewind_pop(&rewind, chip) && opts->movie)
+                movie_pop(opts->movie);
         }
-
-        refresh();
-        napms(deltatime); // 1ms delay to throttle, also gives a consistent deltatime
-    }
-
-    endwin();
-}
-
-u16 gui_get_key_mask(u16 dt)
-{
-    static u64 t = 0;
-    static u16 mask = 0;
-    static u16 last_seen[16];
-
-    // Read pressed keys
-    int ch, key;
-    while ((ch = getch()) != ERR) {
-        // Hand-mapping the keys, I can't be bothered to attempt something cleverer
-        switch (ch) {
-            case '1': key = 0x1; break;
-            case '2': key = 0x2; break;
-            case '3': key = 0x3; break;
-            case '4': key = 0xC; break;
-
-            case 'q': key = 0x4; break;
-            case 'w': key = 0x5; break;
-            case 'e': key = 0x6; break;
-            case 'r': key = 0xD; break;
-
-            case 'a': key = 0x7; break;
-            case 's': key = 0x8; break;
-            case 'd': key = 0x9; break;
-            case 'f': key = 0xE; break;
-
-            case 'z': key = 0xA; break;
-            case 'x': key = 0x0; break;
-            case 'c': key = 0xB; break;
-            case 'v': key = 0xF; break;
-
-            default: return 0xFFFF;
+        else {
+            sched_frame(&sched, chip, key_mask);
+            if (can_rewind)
+                chip_rewind_push(&rewind, chip);
+            if (opts->movie && !movie_push(opts->movie, key_mask))
+                ui_running = false;
+        }
+        if (opts->publisher)
+            publish_frame(opts->publisher, chip);
+        if (chip->quirks == QUIRKS_XO)
+            audio_set_pattern(&audio, chip->pattern_loaded ? chip->pattern : NULL, chip->pitch);
+        audio_set_tone(&audio, chip->sound > 0);
+        if (chip->halted)
+            ui_running = false;
+        // Not drawn yet counts as dropped here, so this can be one frame high
+        u64 dropped = atomic_load_explicit(&render.submitted, memory_order_relaxed) -
+                      atomic_load_explicit(&render.drawn, memory_order_relaxed);
+        bool status = telemetry_frame(&telemetry, chip->dirty != 0, dropped) && opts->status;
+        if (status)
+            render_set_status(&render, telemetry.status);
+        // Switching resolution marks every row, so this also catches hires changes
+        if (chip->dirty || status) {
+            render_submit(&render, chip);
+            chip->dirty = 0;
         }
 
-        if (key < 0)
-            continue;
-
-        mask |= (1 << key);
-        last_seen[key] = t;
+        sched_wait(&sched);
+        telemetry_slept(&telemetry);
     }
 
-    // Remove keys that haven't been pressed for a while
-    for (int i = 0; i < 16; i++)
-        if ((mask & (1 << i)) && (t - last_seen[i] > 40))
-            mask &= ~(1 << i);
-
-    t += dt;
-    return mask;
+    telemetry_finish(&telemetry);
+    render_stop(&render);
+    input_stop(&input);
+    audio_close(&audio);
+    endwin();
+    if (can_rewind)
+        chip_rewind_free(&rewind);
 }
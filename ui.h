@@ -1,8 +1,19 @@
 #pragma once
 #include "chip8.h"
+#include "movie.h"
+#include "publish.h"
+#include <stdio.h>
 
-// The GUI mainloop
-void gui_main(struct chip8 *chip);
+struct gui_opts {
+    u32 ipf;    // Instructions per 60Hz frame, 0 for the default
+    bool turbo; // Run unthrottled
+    u32 rewind_kb; // Size of the rewind history, 0 disables it
+    const char *audio; // Audio backend, see audio_open
+    struct publisher *publisher; // Publish every frame here when not NULL
+    struct chip_movie *movie; // Record each frame's input into this (already movie_start'ed) when not NULL
+    bool status; // Show a line of telemetry under the display
+    FILE *metrics; // Write telemetry here once a second when not NULL, see telemetry.h
+};
 
-// Input handling wrapper, because ncurses is a pain for good input like I need
-u16 gui_get_key_mask(u16 dt);
\ No newline at end of file
+// The GUI mainloop
+void gui_main(struct chip8 *chip, const struct gui_opts *opts);
\ No newline at end of file
@@ -0,0 +1,83 @@
+#define _POSIX_C_SOURCE 200809L
+// chip8-view: watch the frames a ./chip8 -S NAME instance publishes, from another terminal
+#include "publish.h"
+#include <stdio.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+#define VIEW_HZ 60
+
+static volatile sig_atomic_t running = 1;
+
+static void stop(int sig)
+{
+    (void)sig;
+    running = 0;
+}
+
+static bool frame_get(const struct publish_frame *f, int x, int y)
+{
+    if (f->hires)
+        return DISPLAY_HI_GET(f->display, x, y) || (f->planes == 2 && DISPLAY_HI_GET(f->display2, x, y));
+    return DISPLAY_GET(f->display, x, y) || (f->planes == 2 && DISPLAY_GET(f->display2, x, y));
+}
+
+// Half blocks like the GUI, built up in one buffer so each frame is a single write
+static void view_draw(const struct publish_frame *f, u64 now_ns)
+{
+    static char out[DISPLAY_HI_W * (DISPLAY_HI_H / 2) * 3 + 4096];
+    int w = f->hires ? DISPLAY_HI_W : DISPLAY_W;
+    int h = f->hires ? DISPLAY_HI_H : DISPLAY_H;
+    size_t used = snprintf(out, sizeof(out), "\x1b[H\x1b[2Kframe %llu, %.1fms old\n",
+                           (unsigned long long)f->frame, (now_ns - f->time_ns) / 1e6);
+    for (int y = 0; y < h; y += 2) {
+        for (int x = 0; x < w; x++) {
+            bool top = frame_get(f, x, y), bottom = frame_get(f, x, y + 1);
+            const char *c = top && bottom ? "\u2588" : top ? "\u2580" : bottom ? "\u2584" : " ";
+            size_t len = strlen(c);
+            memcpy(&out[used], c, len);
+            used += len;
+        }
+        out[used++] = '\x1b';
+        out[used++] = '[';
+        out[used++] = 'K';
+        out[used++] = '\n';
+    }
+    fwrite(out, 1, used, stdout);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2) {
+        printf("Usage: ./chip8-view NAME\n"
+               "\tNAME\tShared memory name given to ./chip8 -S, eg /chip8\n");
+        return 1;
+    }
+
+    struct publisher p;
+    if (!publish_attach(&p, argv[1])) {
+        perror(argv[1]);
+        return 1;
+    }
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    printf("\x1b[2J\x1b[?25l");
+    u64 shown = 0;
+    static struct publish_frame frame;
+    while (running) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (publish_read(&p, &frame) && frame.frame != shown) {
+            shown = frame.frame;
+            view_draw(&frame, (u64)now.tv_sec * 1000000000 + now.tv_nsec);
+        }
+        nanosleep(&(struct timespec){ .tv_nsec = 1000000000 / VIEW_HZ }, NULL);
+    }
+    printf("\x1b[?25h\n");
+
+    publish_close(&p);
+    return 0;
+}